@@ -0,0 +1,220 @@
+/*Title: basicsqueue.h
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Compile-time configured version of SQueue. The priority
+  functor, heap type and structure are template parameters, so the merge
+  loop and the priority calls can be inlined. SQueue remains the runtime
+  configured queue and shares the same HeapEngine kernels.
+*/
+#ifndef BASICSQUEUE_H
+#define BASICSQUEUE_H
+#include "squeue.h"
+#include <type_traits>
+
+// Adapts an existing priority function to the functor interface, e.g.
+// BasicSQueue<PriorityFnPtr<priorityFn1>, MAXHEAP, SKEW>
+template <prifn_t priFn>
+struct PriorityFnPtr{
+    int operator()(const Post& post) const {return priFn(post);}
+};
+
+// True when PriorityFn has operator== for mergeWithQueue to compare with
+template <class PriorityFn, class = void>
+struct IsComparablePriorityFn : false_type {};
+template <class PriorityFn>
+struct IsComparablePriorityFn<PriorityFn, void_t<decltype(declval<const PriorityFn&>() == declval<const PriorityFn&>())>>
+    : true_type {};
+
+// PriorityFn is any type with int operator()(const Post&) const that
+// returns 0 for invalid posts, like prifn_t. A functor with state (an
+// empty class is stateless) must also have operator==, so mergeWithQueue
+// can refuse queues that compute different priorities.
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+class BasicSQueue{
+    static_assert(structure == SKEW || structure == LEFTIST || structure == PAIRING,
+                  "BasicSQueue supports the SKEW, LEFTIST and PAIRING structures");
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+
+    explicit BasicSQueue(PriorityFn priFn = PriorityFn());
+    BasicSQueue(PriorityFn priFn, shared_ptr<PostPool> pool);
+    ~BasicSQueue();
+    BasicSQueue(const BasicSQueue& rhs);
+    BasicSQueue& operator=(const BasicSQueue& rhs);
+    // Moves take over the nodes and the pool in O(1), like SQueue's. The
+    // moved-from queue is empty and gets a new pool when it needs one.
+    BasicSQueue(BasicSQueue&& rhs) noexcept;
+    BasicSQueue& operator=(BasicSQueue&& rhs) noexcept;
+    bool insertPost(const Post& post);
+    // Batch insert, see SQueue::insertPosts
+    template <class InputIt>
+    int insertPosts(InputIt first, InputIt last);
+    Post getNextPost(); // Returns the highest priority post
+    // Throws domain_error unless both functors compare equal
+    void mergeWithQueue(BasicSQueue& rhs);
+    void clear();
+    int numPosts() const {return m_size;}
+    const PriorityFn& getPriorityFn() const {return m_priorFunc;}
+    static HEAPTYPE getHeapType() {return heapType;}
+    static STRUCTURE getStructure() {return structure;}
+    shared_ptr<PostPool> getPool() const {return m_pool;}
+
+    private:
+    nodeid_t m_heap;             // Root of the heap
+    int m_size;                  // Current size of the heap
+    PriorityFn m_priorFunc;      // Functor to compute priority
+    shared_ptr<PostPool> m_pool; // Allocator for the heap nodes
+    vector<nodeid_t> m_mergePath; // Scratch path for the leftist merge
+    vector<nodeid_t> m_buildList; // Scratch work list for the bulk build
+
+    void ensurePool() {
+        if (!m_pool) m_pool = make_shared<PostPool>();
+    }
+    static bool samePriorityFn(const PriorityFn& fn1, const PriorityFn& fn2) {
+        static_assert(is_empty<PriorityFn>::value || IsComparablePriorityFn<PriorityFn>::value,
+                      "A PriorityFn with state needs operator== to merge queues");
+        if constexpr (is_empty<PriorityFn>::value) {
+            return true;
+        } else {
+            return (fn1 == fn2);
+        }
+    }
+    nodeid_t mergeNodes(nodeid_t h1, nodeid_t h2) {
+        if (h1 == NULLNODE) return h2;
+        if (h2 == NULLNODE) return h1;
+        return HeapEngine::merge<heapType, structure>(m_pool->nodes(), h1, h2, m_mergePath);
+    }
+};
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+BasicSQueue<PriorityFn, heapType, structure>::BasicSQueue(PriorityFn priFn)
+    : m_heap(NULLNODE), m_size(0), m_priorFunc(priFn), m_pool(make_shared<PostPool>()) {}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+BasicSQueue<PriorityFn, heapType, structure>::BasicSQueue(PriorityFn priFn, shared_ptr<PostPool> pool)
+    : m_heap(NULLNODE), m_size(0), m_priorFunc(priFn),
+      m_pool(pool ? pool : make_shared<PostPool>()) {}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+BasicSQueue<PriorityFn, heapType, structure>::~BasicSQueue() {
+    clear();
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+BasicSQueue<PriorityFn, heapType, structure>::BasicSQueue(const BasicSQueue& rhs)
+    : m_size(rhs.m_size), m_priorFunc(rhs.m_priorFunc), m_pool(make_shared<PostPool>()) {
+    m_heap = (rhs.m_heap == NULLNODE ? NULLNODE : HeapEngine::copyTree(*rhs.m_pool, rhs.m_heap, *m_pool));
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+BasicSQueue<PriorityFn, heapType, structure>&
+BasicSQueue<PriorityFn, heapType, structure>::operator=(const BasicSQueue& rhs) {
+    if (this != &rhs) {
+        clear();
+        ensurePool();
+        m_priorFunc = rhs.m_priorFunc;
+        m_size = rhs.m_size;
+        m_heap = (rhs.m_heap == NULLNODE ? NULLNODE : HeapEngine::copyTree(*rhs.m_pool, rhs.m_heap, *m_pool));
+    }
+    return *this;
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+BasicSQueue<PriorityFn, heapType, structure>::BasicSQueue(BasicSQueue&& rhs) noexcept
+    : m_heap(rhs.m_heap), m_size(rhs.m_size), m_priorFunc(std::move(rhs.m_priorFunc)),
+      m_pool(std::move(rhs.m_pool)), m_mergePath(std::move(rhs.m_mergePath)),
+      m_buildList(std::move(rhs.m_buildList)) {
+    rhs.m_heap = NULLNODE;
+    rhs.m_size = 0;
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+BasicSQueue<PriorityFn, heapType, structure>&
+BasicSQueue<PriorityFn, heapType, structure>::operator=(BasicSQueue&& rhs) noexcept {
+    if (this != &rhs) {
+        clear(); // releases without allocating
+        m_priorFunc = std::move(rhs.m_priorFunc);
+        m_heap = rhs.m_heap;
+        m_size = rhs.m_size;
+        m_pool = std::move(rhs.m_pool);
+        m_mergePath = std::move(rhs.m_mergePath);
+        m_buildList = std::move(rhs.m_buildList);
+        rhs.m_heap = NULLNODE;
+        rhs.m_size = 0;
+    }
+    return *this;
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+bool BasicSQueue<PriorityFn, heapType, structure>::insertPost(const Post& post) {
+    int key = m_priorFunc(post);
+    if (key == 0) return false;
+    ensurePool();
+    nodeid_t newNode = m_pool->allocate(post);
+    m_pool->node(newNode).m_key = key;
+    m_heap = mergeNodes(m_heap, newNode);
+    m_size++;
+    return true;
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+template <class InputIt>
+int BasicSQueue<PriorityFn, heapType, structure>::insertPosts(InputIt first, InputIt last) {
+    ensurePool();
+    m_buildList.clear();
+    for (; first != last; ++first) {
+        const Post& post = *first;
+        int key = m_priorFunc(post);
+        if (key == 0) continue;
+        nodeid_t node = m_pool->allocate(post);
+        m_pool->node(node).m_key = key;
+        m_buildList.push_back(node);
+    }
+    int count = (int)m_buildList.size();
+    if (count > 0) {
+        nodeid_t batch = HeapEngine::build<heapType, structure>(m_pool->nodes(), m_buildList, m_mergePath);
+        m_heap = mergeNodes(m_heap, batch);
+    }
+    m_size += count;
+    return count;
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+Post BasicSQueue<PriorityFn, heapType, structure>::getNextPost() {
+    if (m_heap == NULLNODE) {
+        throw out_of_range("Queue is empty");
+    }
+    nodeid_t oldRoot = m_heap;
+    const PostNode& root = m_pool->node(oldRoot);
+    Post result = root.getPost();
+    m_heap = HeapEngine::pop<heapType, structure>(m_pool->nodes(), oldRoot, m_mergePath);
+    m_pool->release(oldRoot);
+    m_size--;
+    return result;
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+void BasicSQueue<PriorityFn, heapType, structure>::mergeWithQueue(BasicSQueue& rhs) {
+    if (this == &rhs) {
+        throw domain_error("Cannot merge queue with itself.");
+    }
+    if (!samePriorityFn(m_priorFunc, rhs.m_priorFunc)) {
+        throw domain_error("Incompatible queues cannot be merged.");
+    }
+    if (rhs.m_heap == NULLNODE) return;
+    ensurePool();
+    nodeid_t rhsHeap = HeapEngine::transferHeap(rhs.m_heap, rhs.m_pool, m_pool);
+    m_heap = mergeNodes(m_heap, rhsHeap);
+    m_size += rhs.m_size;
+    rhs.m_heap = NULLNODE;
+    rhs.m_size = 0;
+}
+
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+void BasicSQueue<PriorityFn, heapType, structure>::clear() {
+    HeapEngine::clearHeap(m_heap, m_pool);
+    m_heap = NULLNODE;
+    m_size = 0;
+}
+#endif
@@ -0,0 +1,136 @@
+/*Title: mappedsqueue.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: This file implements the functions in mappedsqueue.h
+*/
+#include "mappedsqueue.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedSQueue::MappedSQueue(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw domain_error("Cannot open snapshot file " + path);
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+    close(fd);
+    throw domain_error("Snapshot is truncated.");
+  }
+  m_length = (size_t)info.st_size;
+  m_map = mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file open
+  if (m_map == MAP_FAILED) throw domain_error("Cannot map snapshot file " + path);
+  m_header = (const SnapshotHeader*)m_map;
+  m_records = (const SnapshotRecord*)(m_header + 1);
+  try {
+    SnapshotFormat::check(*m_header, m_records, (m_length - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord));
+  } catch (...) {
+    munmap(m_map, m_length);
+    throw;
+  }
+}
+
+MappedSQueue::~MappedSQueue() {
+  munmap(m_map, m_length);
+}
+
+int MappedSQueue::numPosts() const {
+  return (int)m_header->m_numNodes;
+}
+
+HEAPTYPE MappedSQueue::getHeapType() const {
+  return (HEAPTYPE)m_header->m_heapType;
+}
+
+STRUCTURE MappedSQueue::getStructure() const {
+  return (STRUCTURE)m_header->m_structure;
+}
+
+Post MappedSQueue::peek() const {
+  if (m_header->m_numNodes == 0) {
+    throw out_of_range("Queue is empty");
+  }
+  return postAt(m_records[bestRecord()]);
+}
+
+optional<Post> MappedSQueue::tryPeek() const {
+  if (m_header->m_numNodes == 0) return nullopt;
+  return peek();
+}
+
+vector<Post> MappedSQueue::topK(int k) const {
+  vector<Post> posts;
+  MappedIterator it = orderedPosts();
+  while ((int)posts.size() < k && it.hasNext()) posts.push_back(it.next());
+  return posts;
+}
+
+MappedIterator MappedSQueue::orderedPosts() const {
+  return MappedIterator(*this);
+}
+
+// Like SQueue::bestNode: the first flat record is the array heap root or
+// the best bucket node, which wins ties against the tree root
+uint32_t MappedSQueue::bestRecord() const {
+  uint32_t numFlat = m_header->m_numFlat;
+  if (numFlat == 0) return 0;
+  if (numFlat == m_header->m_numNodes ||
+      !higherPriority(m_records[numFlat].m_key, m_records[0].m_key)) return 0;
+  return numFlat;
+}
+
+bool MappedSQueue::higherPriority(int key1, int key2) const {
+  return (m_header->m_heapType == MINHEAP ? key1 < key2 : key1 > key2);
+}
+
+Post MappedSQueue::postAt(const SnapshotRecord& record) {
+  return PostNode{record.m_fields, record.m_key, NULLNODE, NULLNODE, NULLNODE}.getPost();
+}
+
+// --- MappedIterator ---
+MappedIterator::MappedIterator(const MappedSQueue& queue) {
+  m_queue = &queue;
+  const SnapshotHeader& header = *queue.m_header;
+  if (header.m_numFlat > 0) push(0);
+  if (header.m_numFlat < header.m_numNodes) push(header.m_numFlat);
+}
+
+Post MappedIterator::next() {
+  if (m_frontier.empty()) {
+    throw out_of_range("No more posts");
+  }
+  auto lower = [this](uint32_t index1, uint32_t index2) { return lowerPriority(index1, index2); };
+  pop_heap(m_frontier.begin(), m_frontier.end(), lower);
+  uint32_t best = m_frontier.back();
+  m_frontier.pop_back();
+  const SnapshotHeader& header = *m_queue->m_header;
+  const SnapshotRecord* records = m_queue->m_records;
+  if (best < header.m_numFlat) {
+    if (header.m_structure == DARY) {
+      uint64_t first = (uint64_t)best * DARYARITY + 1;
+      for (uint64_t pos = first; pos < first + DARYARITY && pos < header.m_numNodes; pos++) push((uint32_t)pos);
+    } else if (best + 1 < header.m_numFlat) {
+      push(best + 1);
+    }
+  } else if (header.m_structure == PAIRING) {
+    // Siblings are not ordered among themselves, every child is a candidate
+    uint32_t child = (records[best].m_links & SNAPSHOTLEFT ? best + 1 : 0);
+    for (; child != 0; child = records[child].m_links & SNAPSHOTRIGHT) push(child);
+  } else {
+    if (records[best].m_links & SNAPSHOTLEFT) push(best + 1);
+    if (records[best].m_links & SNAPSHOTRIGHT) push(records[best].m_links & SNAPSHOTRIGHT);
+  }
+  return MappedSQueue::postAt(records[best]);
+}
+
+void MappedIterator::push(uint32_t index) {
+  m_frontier.push_back(index);
+  push_heap(m_frontier.begin(), m_frontier.end(),
+            [this](uint32_t index1, uint32_t index2) { return lowerPriority(index1, index2); });
+}
+
+bool MappedIterator::lowerPriority(uint32_t index1, uint32_t index2) const {
+  return m_queue->higherPriority(m_queue->m_records[index2].m_key, m_queue->m_records[index1].m_key);
+}
@@ -0,0 +1,64 @@
+/*Title: mappedsqueue.h
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Read-only view of a queue snapshot (see
+  SQueue::saveSnapshot) mapped into memory with mmap. peek, topK and the
+  ordered iteration read the records in place from the mapped pages, so a
+  large snapshot can be inspected without loading it into an SQueue.
+  Opening the view checks the file like loadSnapshot does. POSIX only.
+*/
+#ifndef MAPPEDSQUEUE_H
+#define MAPPEDSQUEUE_H
+#include "squeue.h"
+
+class MappedIterator; // forward declaration
+
+class MappedSQueue{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+    friend class MappedIterator;
+
+    // Throws domain_error for a missing, truncated or damaged file
+    explicit MappedSQueue(const string& path);
+    ~MappedSQueue();
+    MappedSQueue(const MappedSQueue& rhs) = delete;
+    MappedSQueue& operator=(const MappedSQueue& rhs) = delete;
+
+    int numPosts() const;
+    HEAPTYPE getHeapType() const;
+    STRUCTURE getStructure() const;
+    Post peek() const; // Throws out_of_range if empty
+    optional<Post> tryPeek() const;
+    vector<Post> topK(int k) const;
+    MappedIterator orderedPosts() const; // Lazy walk over every post in order
+
+    private:
+    void* m_map;                      // the whole file, mapped read only
+    size_t m_length;                  // bytes mapped
+    const SnapshotHeader* m_header;   // start of m_map
+    const SnapshotRecord* m_records;  // right after the header
+
+    uint32_t bestRecord() const; // record peek returns, the view must not be empty
+    bool higherPriority(int key1, int key2) const; // key1 goes first
+    static Post postAt(const SnapshotRecord& record);
+};
+
+// Same frontier walk as OrderedIterator, over record indices. A record
+// below m_numFlat is an array heap position (DARY) or the next bucket
+// node in pop order (BUCKET), anything after it is a tree node.
+class MappedIterator{
+    public:
+    friend class MappedSQueue;
+    bool hasNext() const {return !m_frontier.empty();}
+    Post next(); // Throws out_of_range when every post has been returned
+
+    private:
+    const MappedSQueue* m_queue;
+    vector<uint32_t> m_frontier; // heap of record indices, best on top
+
+    explicit MappedIterator(const MappedSQueue& queue);
+    void push(uint32_t index);
+    bool lowerPriority(uint32_t index1, uint32_t index2) const;
+};
+#endif
@@ -0,0 +1,121 @@
+/*Title: mqbench.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Scaling benchmark for MultiSQueue. Every thread repeatedly
+  inserts a post and pops one, for 1 to 64 threads, against a single
+  SQueue behind one mutex, a relaxed MultiSQueue and a strict one. It then
+  measures how far relaxed pops drift from the exact order: the rank error
+  of a pop is the number of queued posts with a strictly better key.
+
+  Build: cmake target mqbench
+  Usage: ./mqbench [operations per run]
+*/
+#include "multisqueue.h"
+#include <chrono>
+#include <random>
+#include <thread>
+#include <iomanip>
+using namespace std;
+
+const int PREFILL = 100000;//posts queued before the timed run
+const int KEYRANGE = 511;//keys of benchPriority are 1..510
+
+int benchPriority(const Post &post) {
+    int priority = post.getNumLikes() + post.getInterestLevel();
+    return (priority >= 1 && priority <= 510) ? priority : 0;
+}
+
+Post benchPost(minstd_rand &generator) {
+    return Post(MINPOSTID + (int)(generator() % (MAXPOSTID - MINPOSTID)),
+                MINLIKES + (int)(generator() % (MAXLIKES - MINLIKES + 1)),
+                MINCONLEVEL + (int)(generator() % (MAXCONLEVEL - MINCONLEVEL + 1)),
+                MINTIME + (int)(generator() % (MAXTIME - MINTIME + 1)),
+                MININTERESTLEVEL + (int)(generator() % (MAXINTERESTLEVEL - MININTERESTLEVEL + 1)));
+}
+
+// The baseline: one SQueue shared through a single mutex
+class LockedSQueue{
+    public:
+    LockedSQueue() : m_queue(benchPriority, MAXHEAP, SKEW) {}
+    void insertPost(const Post& post) {
+        lock_guard<mutex> lock(m_lock);
+        m_queue.insertPost(post);
+    }
+    bool tryGetNextPost(Post& post) {
+        lock_guard<mutex> lock(m_lock);
+        return m_queue.tryGetNextPost(post);
+    }
+    private:
+    mutex m_lock;
+    SQueue m_queue;
+};
+
+// Runs numThreads threads doing insert/pop pairs, returns operations per second
+template <class Queue>
+double runMixed(Queue& queue, int numThreads, int operations) {
+    minstd_rand generator(1);
+    for (int i = 0; i < PREFILL; i++) queue.insertPost(benchPost(generator));
+    int perThread = operations / numThreads / 2;
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&queue, perThread, t]() {
+            minstd_rand local(t + 2);
+            Post post;
+            for (int i = 0; i < perThread; i++) {
+                queue.insertPost(benchPost(local));
+                queue.tryGetNextPost(post);
+            }
+        });
+    }
+    for (thread& worker : threads) worker.join();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return 2.0 * perThread * numThreads / elapsed.count();
+}
+
+// Drains a prefilled relaxed queue and reports mean and max rank error
+void measureDrift(int numShards) {
+    MultiSQueue queue(benchPriority, MAXHEAP, SKEW, numShards);
+    vector<int> count(KEYRANGE + 1, 0);
+    minstd_rand generator(1);
+    for (int i = 0; i < PREFILL; i++) {
+        Post post = benchPost(generator);
+        if (queue.insertPost(post)) count[benchPriority(post)]++;
+    }
+    double total = 0;
+    long long maxError = 0;
+    long long pops = 0;
+    Post post;
+    while (queue.tryGetNextPost(post)) {
+        int key = benchPriority(post);
+        long long error = 0;
+        for (int better = key + 1; better <= KEYRANGE; better++) error += count[better];
+        count[key]--;
+        total += error;
+        maxError = max(maxError, error);
+        pops++;
+    }
+    cout << setw(8) << numShards << setw(14) << fixed << setprecision(1) << total / pops
+         << setw(12) << maxError << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    int operations = (argc > 1 ? atoi(argv[1]) : 2000000);
+    int threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+    cout << "Throughput (million operations per second), " << operations << " operations\n";
+    cout << setw(8) << "threads" << setw(12) << "mutex" << setw(12) << "relaxed" << setw(12) << "strict" << "\n";
+    for (int numThreads : threadCounts) {
+        LockedSQueue locked;
+        MultiSQueue relaxed(benchPriority, MAXHEAP, SKEW);
+        MultiSQueue strict(benchPriority, MAXHEAP, SKEW, 0, true);
+        cout << setw(8) << numThreads << fixed << setprecision(2)
+             << setw(12) << runMixed(locked, numThreads, operations) / 1e6
+             << setw(12) << runMixed(relaxed, numThreads, operations) / 1e6
+             << setw(12) << runMixed(strict, numThreads, operations) / 1e6 << "\n";
+    }
+    cout << "\nRank error of relaxed pops, " << PREFILL << " posts\n";
+    cout << setw(8) << "shards" << setw(14) << "mean" << setw(12) << "max" << "\n";
+    int shardCounts[] = {1, 4, 16, 64, 128};
+    for (int numShards : shardCounts) measureDrift(numShards);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*Title: multisqueue.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: This file implements the functions in multisqueue.h
+*/
+#include "multisqueue.h"
+#include <random>
+#include <thread>
+
+MultiSQueue::MultiSQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure,
+                         int numShards, bool strict) {
+  if (numShards <= 0) numShards = 2 * max(1, (int)thread::hardware_concurrency());
+  for (int i = 0; i < numShards; i++) {
+    m_shards.push_back(make_unique<Shard>(priFn, heapType, structure));
+  }
+  m_heapType = heapType;
+  m_strict = strict;
+  m_size = 0;
+}
+
+// Inserts try a few random shards without blocking before waiting on one
+bool MultiSQueue::insertPost(const Post& post) {
+  for (int attempt = 0; ; attempt++) {
+    Shard& shard = *m_shards[randomShard()];
+    unique_lock<mutex> lock(shard.m_lock, try_to_lock);
+    if (!lock.owns_lock()) {
+      if (attempt < MAXSHARDATTEMPTS) continue;
+      lock.lock();
+    }
+    if (!shard.m_queue.insertPost(post)) return false;
+    shard.m_bestKey.store(shard.m_queue.bestKey(), memory_order_relaxed);
+    m_size.fetch_add(1, memory_order_relaxed);
+    return true;
+  }
+}
+
+Post MultiSQueue::getNextPost() {
+  Post post;
+  if (!tryGetNextPost(post)) {
+    throw out_of_range("Queue is empty");
+  }
+  return post;
+}
+
+optional<Post> MultiSQueue::tryGetNextPost() {
+  Post post;
+  if (!tryGetNextPost(post)) return nullopt;
+  return post;
+}
+
+// Relaxed pop: the better of two random shards. Shards that are locked
+// or emptied by another consumer are skipped, and after MAXSHARDATTEMPTS
+// misses every shard is tried in turn. An empty queue returns false
+// without scanning the shards.
+bool MultiSQueue::tryGetNextPost(Post& post) {
+  if (m_size.load(memory_order_relaxed) <= 0) return false;
+  if (m_strict) return popStrict(post);
+  int numShards = (int)m_shards.size();
+  for (int attempt = 0; attempt < MAXSHARDATTEMPTS; attempt++) {
+    if (m_size.load(memory_order_relaxed) <= 0) return false;
+    int first = randomShard();
+    int second = (numShards > 1 ? randomShard() : first);
+    int key1 = m_shards[first]->m_bestKey.load(memory_order_relaxed);
+    int key2 = m_shards[second]->m_bestKey.load(memory_order_relaxed);
+    Shard& shard = *m_shards[better(key2, key1) ? second : first];
+    if (shard.m_bestKey.load(memory_order_relaxed) == 0) continue;
+    unique_lock<mutex> lock(shard.m_lock, try_to_lock);
+    if (lock.owns_lock() && popFrom(shard, post)) return true;
+  }
+  if (m_size.load(memory_order_relaxed) <= 0) return false;
+  return popScan(post);
+}
+
+void MultiSQueue::clear() {
+  for (unique_ptr<Shard>& shard : m_shards) {
+    lock_guard<mutex> lock(shard->m_lock);
+    m_size.fetch_sub(shard->m_queue.numPosts(), memory_order_relaxed);
+    shard->m_queue.clear();
+    shard->m_bestKey.store(0, memory_order_relaxed);
+  }
+}
+
+int MultiSQueue::numPosts() const {
+  return m_size.load(memory_order_relaxed);
+}
+
+int MultiSQueue::numShards() const {
+  return (int)m_shards.size();
+}
+
+bool MultiSQueue::isStrict() const {
+  return m_strict;
+}
+
+HEAPTYPE MultiSQueue::getHeapType() const {
+  return m_heapType;
+}
+
+bool MultiSQueue::better(int key1, int key2) const {
+  if (key1 == 0) return false;
+  if (key2 == 0) return true;
+  return (m_heapType == MINHEAP ? key1 < key2 : key1 > key2);
+}
+
+// Each thread has its own generator, seeded from its id
+int MultiSQueue::randomShard() const {
+  thread_local minstd_rand generator((unsigned)hash<thread::id>()(this_thread::get_id()));
+  return (int)(generator() % m_shards.size());
+}
+
+bool MultiSQueue::popFrom(Shard& shard, Post& post) {
+  if (!shard.m_queue.tryGetNextPost(post)) return false;
+  shard.m_bestKey.store(shard.m_queue.bestKey(), memory_order_relaxed);
+  m_size.fetch_sub(1, memory_order_relaxed);
+  return true;
+}
+
+// Locks every shard in index order, inserts only ever hold one lock so
+// this cannot deadlock.
+bool MultiSQueue::popStrict(Post& post) {
+  vector<unique_lock<mutex>> locks;
+  locks.reserve(m_shards.size());
+  Shard* best = nullptr;
+  int bestKey = 0;
+  for (unique_ptr<Shard>& shard : m_shards) {
+    locks.emplace_back(shard->m_lock);
+    int key = shard->m_queue.bestKey();
+    if (better(key, bestKey)) {
+      best = shard.get();
+      bestKey = key;
+    }
+  }
+  return (best != nullptr && popFrom(*best, post));
+}
+
+bool MultiSQueue::popScan(Post& post) {
+  int numShards = (int)m_shards.size();
+  int start = randomShard();
+  for (int i = 0; i < numShards; i++) {
+    Shard& shard = *m_shards[(start + i) % numShards];
+    lock_guard<mutex> lock(shard.m_lock);
+    if (popFrom(shard, post)) return true;
+  }
+  return false;
+}
@@ -0,0 +1,71 @@
+/*Title: multisqueue.h
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Thread-safe queue of posts built from several SQueue shards
+  (a MultiQueue). Each shard has its own lock, so producers and consumers
+  working on different shards never wait for each other.
+
+  Inserts go to a random shard. Relaxed pops look at the best keys of two
+  random shards and pop from the better one, so a pop may return a post
+  that is not the global best. With n shards the rank of the popped post
+  among the queued posts is O(n) on average and O(n log n) with high
+  probability (two-choice analysis of MultiQueues). Strict mode locks every
+  shard for a pop and returns exactly the best post, at the cost of
+  serializing the consumers.
+*/
+#ifndef MULTISQUEUE_H
+#define MULTISQUEUE_H
+#include "squeue.h"
+#include <atomic>
+#include <mutex>
+
+const int MAXSHARDATTEMPTS = 16;//random shards tried before an insert blocks or a pop scans
+
+class MultiSQueue{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+
+    // numShards 0 picks two shards per hardware thread
+    MultiSQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure,
+                int numShards = 0, bool strict = false);
+    MultiSQueue(const MultiSQueue& rhs) = delete;
+    MultiSQueue& operator=(const MultiSQueue& rhs) = delete;
+
+    // Returns false for posts the priority function rejects
+    bool insertPost(const Post& post);
+    // Throws out_of_range when no shard has a post
+    Post getNextPost();
+    // Return false/nullopt when every shard was seen empty
+    bool tryGetNextPost(Post& post);
+    optional<Post> tryGetNextPost();
+    void clear();
+    // Exact only while no other thread inserts or pops
+    int numPosts() const;
+    int numShards() const;
+    bool isStrict() const;
+    HEAPTYPE getHeapType() const;
+
+    private:
+    // Padded to a cache line so the locks of neighbouring shards do not
+    // share one
+    struct alignas(64) Shard{
+        mutex m_lock;
+        SQueue m_queue;
+        atomic<int> m_bestKey; // m_queue.bestKey(), read without the lock
+        Shard(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure)
+            : m_queue(priFn, heapType, structure), m_bestKey(0) {}
+    };
+
+    vector<unique_ptr<Shard>> m_shards;
+    HEAPTYPE m_heapType;
+    bool m_strict;
+    atomic<int> m_size; // posts in all shards
+
+    bool better(int key1, int key2) const; // key1 pops first, 0 means empty
+    int randomShard() const;
+    bool popFrom(Shard& shard, Post& post); // caller holds shard.m_lock
+    bool popStrict(Post& post);
+    bool popScan(Post& post);
+};
+#endif
@@ -0,0 +1,125 @@
+/*Title: multiviewsqueue.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: This file implements the functions in multiviewsqueue.h
+*/
+#include "multiviewsqueue.h"
+
+MultiViewSQueue::MultiViewSQueue() {
+  m_size = 0;
+}
+
+int MultiViewSQueue::addView(prifn_t priFn, HEAPTYPE heapType) {
+  if (priFn == nullptr) throw domain_error("A view needs a priority function.");
+  m_views.push_back(View{priFn, heapType, IndexedHeap()});
+  View& added = m_views.back();
+  for (nodeid_t slot = 0; slot < m_posts.size(); slot++) {
+    if (!m_used[slot]) continue;
+    int key = priFn(m_posts[slot]);
+    if (key == 0) removeSlot(slot);
+    else added.m_heap.push(key, slot, added.m_heapType);
+  }
+  return (int)m_views.size() - 1;
+}
+
+int MultiViewSQueue::numViews() const {
+  return (int)m_views.size();
+}
+
+// Every priority is computed before anything changes, so a rejected post
+// leaves no trace
+bool MultiViewSQueue::insertPost(const Post& post) {
+  if (m_views.empty()) throw domain_error("No view is registered.");
+  m_keys.clear();
+  for (const View& view : m_views) {
+    int key = view.m_priorFunc(post);
+    if (key == 0) return false;
+    m_keys.push_back(key);
+  }
+  nodeid_t slot;
+  if (!m_free.empty()) {
+    slot = m_free.back();
+    m_free.pop_back();
+    m_posts[slot] = post;
+    m_used[slot] = true;
+  } else {
+    slot = (nodeid_t)m_posts.size();
+    m_posts.push_back(post);
+    m_used.push_back(true);
+  }
+  for (size_t v = 0; v < m_views.size(); v++) {
+    m_views[v].m_heap.push(m_keys[v], slot, m_views[v].m_heapType);
+  }
+  m_size++;
+  return true;
+}
+
+Post MultiViewSQueue::getNextPost(int view) {
+  Post post;
+  if (!tryGetNextPost(view, post)) {
+    throw out_of_range("Queue is empty");
+  }
+  return post;
+}
+
+Post MultiViewSQueue::peek(int view) const {
+  const View& top = checkView(view);
+  if (top.m_heap.empty()) {
+    throw out_of_range("Queue is empty");
+  }
+  return m_posts[top.m_heap.top()];
+}
+
+bool MultiViewSQueue::tryGetNextPost(int view, Post& post) {
+  const View& top = checkView(view);
+  if (top.m_heap.empty()) return false;
+  nodeid_t slot = top.m_heap.top();
+  post = m_posts[slot];
+  removeSlot(slot);
+  return true;
+}
+
+optional<Post> MultiViewSQueue::tryGetNextPost(int view) {
+  Post post;
+  if (!tryGetNextPost(view, post)) return nullopt;
+  return post;
+}
+
+optional<Post> MultiViewSQueue::tryPeek(int view) const {
+  const View& top = checkView(view);
+  if (top.m_heap.empty()) return nullopt;
+  return m_posts[top.m_heap.top()];
+}
+
+// The views stay registered
+void MultiViewSQueue::clear() {
+  for (View& view : m_views) view.m_heap.release();
+  m_posts.clear();
+  m_used.clear();
+  m_free.clear();
+  m_size = 0;
+}
+
+int MultiViewSQueue::numPosts() const {
+  return m_size;
+}
+
+prifn_t MultiViewSQueue::getPriorityFn(int view) const {
+  return checkView(view).m_priorFunc;
+}
+
+HEAPTYPE MultiViewSQueue::getHeapType(int view) const {
+  return checkView(view).m_heapType;
+}
+
+const MultiViewSQueue::View& MultiViewSQueue::checkView(int view) const {
+  if (view < 0 || view >= (int)m_views.size()) throw domain_error("No such view.");
+  return m_views[view];
+}
+
+void MultiViewSQueue::removeSlot(nodeid_t slot) {
+  for (View& view : m_views) view.m_heap.remove(slot, view.m_heapType);
+  m_used[slot] = false;
+  m_free.push_back(slot);
+  m_size--;
+}
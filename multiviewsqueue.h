@@ -0,0 +1,62 @@
+/*Title: multiviewsqueue.h
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: One set of posts ranked under several priority functions
+  at once. Every post is stored once in a slot. Each registered view
+  (a priority function and a heap type) keeps its own IndexedHeap
+  (squeue.h) of (key, slot) entries in the view's order, which also holds
+  the heap position of every slot. Keeping two rankings costs about 12
+  bytes per post per view, with no second copy of the posts and no
+  rebuild when switching between them. A pop from any view removes the
+  post from every view in O(log n) each.
+*/
+#ifndef MULTIVIEWSQUEUE_H
+#define MULTIVIEWSQUEUE_H
+#include "squeue.h"
+
+class MultiViewSQueue{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+
+    MultiViewSQueue();
+    // Registers a view and returns its number, views are numbered from 0.
+    // Posts already queued are ranked in O(n log n), and those the new
+    // function rejects (priority 0) leave every view.
+    int addView(prifn_t priFn, HEAPTYPE heapType);
+    int numViews() const;
+    // A post is queued only if every view accepts it. Throws domain_error
+    // while no view is registered.
+    bool insertPost(const Post& post);
+    // The view's highest priority post, taken out of every view. Throw
+    // domain_error for an unknown view and out_of_range if empty.
+    Post getNextPost(int view);
+    Post peek(int view) const;
+    // Return false/nullopt if empty, domain_error for an unknown view
+    bool tryGetNextPost(int view, Post& post);
+    optional<Post> tryGetNextPost(int view);
+    optional<Post> tryPeek(int view) const;
+    void clear();
+    int numPosts() const;
+    prifn_t getPriorityFn(int view) const;
+    HEAPTYPE getHeapType(int view) const;
+
+    private:
+    // m_heap is kept in the view's order, its top is the view's best post
+    struct View{
+        prifn_t m_priorFunc;
+        HEAPTYPE m_heapType;
+        IndexedHeap m_heap;
+    };
+
+    vector<Post> m_posts;    // the posts, by slot
+    vector<bool> m_used;     // slot holds a queued post
+    vector<nodeid_t> m_free; // slots to reuse
+    vector<View> m_views;
+    vector<int> m_keys;      // scratch keys of the post being inserted
+    int m_size;
+
+    const View& checkView(int view) const; // throws domain_error for an unknown view
+    void removeSlot(nodeid_t slot); // takes the post out of every view
+};
+#endif
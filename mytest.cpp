@@ -5,10 +5,23 @@
   Each test function returns true if the test passes, false otherwise.
 */
 #include "squeue.h"
+#include "basicsqueue.h"
+#include "multisqueue.h"
+#include "mappedsqueue.h"
+#include "postloader.h"
+#include "persistentsqueue.h"
+#include "multiviewsqueue.h"
+#include "randomgen.h"
 #include <math.h>
 #include <algorithm>
 #include <random>
 #include <vector>
+#include <thread>
+#include <map>
+#include <sstream>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
 using namespace std;
 
 // ---------------------- Priority Functions ----------------------
@@ -22,130 +35,33 @@ int priorityFn2(const Post &post) {
     return (priority >= 2 && priority <= 55) ? priority : 0;
 }
 
-enum RANDOM {UNIFORMINT, UNIFORMREAL, NORMAL, SHUFFLE};
-class Random {
-public:
-    Random(){}
-    Random(int min, int max, RANDOM type=UNIFORMINT, int mean=50, int stdev=20) : m_min(min), m_max(max), m_type(type){
-        if (type == NORMAL){
-            //the case of NORMAL to generate integer numbers with normal distribution
-            m_generator = std::mt19937(m_device());
-            //the data set will have the mean of 50 (default) and standard deviation of 20 (default)
-            //the mean and standard deviation can change by passing new values to constructor 
-            m_normdist = std::normal_distribution<>(mean,stdev);
-        }
-        else if (type == UNIFORMINT) {
-            //the case of UNIFORMINT to generate integer numbers
-            // Using a fixed seed value generates always the same sequence
-            // of pseudorandom numbers, e.g. reproducing scientific experiments
-            // here it helps us with testing since the same sequence repeats
-            m_generator = std::mt19937(10);// 10 is the fixed seed value
-            m_unidist = std::uniform_int_distribution<>(min,max);
-        }
-        else if (type == UNIFORMREAL) { //the case of UNIFORMREAL to generate real numbers
-            m_generator = std::mt19937(10);// 10 is the fixed seed value
-            m_uniReal = std::uniform_real_distribution<double>((double)min,(double)max);
-        }
-        else { //the case of SHUFFLE to generate every number only once
-            m_generator = std::mt19937(m_device());
-        }
-    }
-    void setSeed(int seedNum){
-        // we have set a default value for seed in constructor
-        // we can change the seed by calling this function after constructor call
-        // this gives us more randomness
-        m_generator = std::mt19937(seedNum);
-    }
-    void init(int min, int max){
-        m_min = min;
-        m_max = max;
-        m_type = UNIFORMINT;
-        m_generator = std::mt19937(10);// 10 is the fixed seed value
-        m_unidist = std::uniform_int_distribution<>(min,max);
-    }
-    void getShuffle(vector<int> & array){
-        // this function provides a list of all values between min and max
-        // in a random order, this function guarantees the uniqueness
-        // of every value in the list
-        // the user program creates the vector param and passes here
-        // here we populate the vector using m_min and m_max
-        for (int i = m_min; i<=m_max; i++){
-            array.push_back(i);
-        }
-        shuffle(array.begin(),array.end(),m_generator);
-    }
-
-    void getShuffle(int array[]){
-        // this function provides a list of all values between min and max
-        // in a random order, this function guarantees the uniqueness
-        // of every value in the list
-        // the param array must be of the size (m_max-m_min+1)
-        // the user program creates the array and pass it here
-        vector<int> temp;
-        for (int i = m_min; i<=m_max; i++){
-            temp.push_back(i);
-        }
-        std::shuffle(temp.begin(), temp.end(), m_generator);
-        vector<int>::iterator it;
-        int i = 0;
-        for (it=temp.begin(); it != temp.end(); it++){
-            array[i] = *it;
-            i++;
-        }
-    }
-
-    int getRandNum(){
-        // this function returns integer numbers
-        // the object must have been initialized to generate integers
-        int result = 0;
-        if(m_type == NORMAL){
-            //returns a random number in a set with normal distribution
-            //we limit random numbers by the min and max values
-            result = m_min - 1;
-            while(result < m_min || result > m_max)
-                result = m_normdist(m_generator);
-        }
-        else if (m_type == UNIFORMINT){
-            //this will generate a random number between min and max values
-            result = m_unidist(m_generator);
-        }
-        return result;
-    }
-
-    double getRealRandNum(){
-        // this function returns real numbers
-        // the object must have been initialized to generate real numbers
-        double result = m_uniReal(m_generator);
-        // a trick to return numbers only with two deciaml points
-        // for example if result is 15.0378, function returns 15.03
-        // to round up we can use ceil function instead of floor
-        result = std::floor(result*100.0)/100.0;
-        return result;
-    }
-
-    string getRandString(int size){
-        // the parameter size specifies the length of string we ask for
-        // to use ASCII char the number range in constructor must be set to 97 - 122
-        // and the Random type must be UNIFORMINT (it is default in constructor)
-        string output = "";
-        for (int i=0;i<size;i++){
-            output = output + (char)getRandNum();
-        }
-        return output;
-    }
-    
-    int getMin(){return m_min;}
-    int getMax(){return m_max;}
-    private:
-    int m_min;
-    int m_max;
-    RANDOM m_type;
-    std::random_device m_device;
-    std::mt19937 m_generator;
-    std::normal_distribution<> m_normdist;//normal distribution
-    std::uniform_int_distribution<> m_unidist;//integer uniform distribution
-    std::uniform_real_distribution<double> m_uniReal;//real uniform distribution
+// Counts calls so tests can check how often a queue evaluates priorities
+int priorityCalls = 0;
+int countingPriorityFn(const Post &post) {
+    priorityCalls++;
+    return priorityFn1(post);
+}
+
+// Every valid post has its own key
+int postIdPriority(const Post &post) {
+    return post.getPostID();
+}
+
+// Rejects every post
+int rejectAllFn(const Post &) {
+    return 0;
+}
 
+// Throws on every call, for the exception paths
+int throwingFn(const Post &) {
+    throw runtime_error("priority failed");
+}
+
+// A functor with state, for BasicSQueue
+struct ScaledPriority{
+    int m_scale;
+    int operator()(const Post &post) const {return priorityFn1(post) * m_scale;}
+    bool operator==(const ScaledPriority &rhs) const {return m_scale == rhs.m_scale;}
 };
 
 // ---------------------- Tester Class Definition ----------------------
@@ -382,13 +298,1213 @@ class Tester {
         }
         return false;
     }
+
+    // Test that popped nodes are recycled by the pool instead of new slabs.
+    bool testPoolReusesNodes() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue(priorityFn1, MAXHEAP, SKEW);
+        const int numNodes = 200;
+        for (int i = 0; i < numNodes; i++) {
+            queue.insertPost(randomPost(randGen));
+        }
+        int capacity = queue.m_pool->capacity();
+        for (int i = 0; i < 50; i++) queue.getNextPost();
+        if (queue.m_pool->numFree() != 50) return false;
+        for (int i = 0; i < 50; i++) {
+            queue.insertPost(randomPost(randGen));
+        }
+        if (queue.m_pool->capacity() != capacity || queue.m_pool->numFree() != 0) return false;
+        queue.clear();
+        return (queue.m_pool->capacity() == 0 && queue.numPosts() == 0);
+    }
+
+    // Test merging queues with private and shared pools.
+    bool testMergePools() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue1(priorityFn2, MINHEAP, LEFTIST);
+        SQueue queue2(priorityFn2, MINHEAP, LEFTIST);
+        shared_ptr<PostPool> shared = make_shared<PostPool>();
+        SQueue queue3(priorityFn2, MINHEAP, LEFTIST, shared);
+        SQueue queue4(priorityFn2, MINHEAP, LEFTIST, shared);
+        for (int i = 0; i < 100; i++) {
+            queue1.insertPost(randomPost(randGen));
+            queue2.insertPost(randomPost(randGen));
+            queue3.insertPost(randomPost(randGen));
+            queue4.insertPost(randomPost(randGen));
+        }
+        nodeid_t root2 = queue2.m_heap;
+        queue1.mergeWithQueue(queue2); // adopts queue2's slab, no node moves
+        if (queue2.m_pool->capacity() != 0 || queue1.m_pool->capacity() != 200) return false;
+        if (queue2.m_pool->numSlabs() != 0 || queue1.m_pool->numSlabs() != 2) return false;
+        if (!queue1.m_pool->owns(root2) || queue2.m_pool->owns(root2) || !checkParents(queue1)) return false;
+        queue1.mergeWithQueue(queue3); // copies out of the shared pool
+        queue4.insertPost(randomPost(randGen));
+        if (queue1.numPosts() != 300 || queue3.numPosts() != 0) return false;
+        vector<int> priorities;
+        while (queue1.numPosts() > 0) {
+            priorities.push_back(priorityFn2(queue1.getNextPost()));
+        }
+        return (priorities.size() == 300 && checkRemovalOrder(priorities, true));
+    }
+
+    // Helper: Check NPL values and NPL(left) >= NPL(right) on every node.
+    bool checkLeftist(const SQueue& queue) {
+        vector<nodeid_t> stack;
+        if (queue.m_heap != NULLNODE) stack.push_back(queue.m_heap);
+        while (!stack.empty()) {
+            const PostNode& n = queue.m_pool->node(stack.back());
+            stack.pop_back();
+            int nplLeft = (n.m_left ? queue.m_pool->node(n.m_left).npl() : 0);
+            int nplRight = (n.m_right ? queue.m_pool->node(n.m_right).npl() : 0);
+            if (nplLeft < nplRight) return false;
+            if (n.npl() != (n.m_right ? nplRight + 1 : 0)) return false;
+            if (n.m_left) stack.push_back(n.m_left);
+            if (n.m_right) stack.push_back(n.m_right);
+        }
+        return true;
+    }
+
+    // Helper: Check that every child links back to its parent.
+    bool checkParents(const SQueue& queue) {
+        vector<nodeid_t> stack;
+        if (queue.m_heap != NULLNODE) {
+            if (queue.m_pool->node(queue.m_heap).m_parent != NULLNODE) return false;
+            stack.push_back(queue.m_heap);
+        }
+        while (!stack.empty()) {
+            nodeid_t id = stack.back();
+            const PostNode& n = queue.m_pool->node(id);
+            stack.pop_back();
+            if (n.m_left && queue.m_pool->node(n.m_left).m_parent != id) return false;
+            if (n.m_right && queue.m_pool->node(n.m_right).m_parent != id) return false;
+            if (n.m_left) stack.push_back(n.m_left);
+            if (n.m_right) stack.push_back(n.m_right);
+        }
+        return true;
+    }
+
+    // Test the leftist invariants directly after inserts, pops and a merge.
+    bool testLeftistInvariants() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue1(priorityFn1, MAXHEAP, LEFTIST);
+        SQueue queue2(priorityFn1, MAXHEAP, LEFTIST);
+        for (int i = 0; i < 1000; i++) {
+            queue1.insertPost(randomPost(randGen));
+            queue2.insertPost(randomPost(randGen));
+        }
+        for (int i = 0; i < 300; i++) queue1.getNextPost();
+        queue1.mergeWithQueue(queue2);
+        return checkLeftist(queue1);
+    }
+
+    // Test that a degenerate 500000 node chain can be copied, rebuilt and
+    // cleared without running out of stack.
+    bool testDeepHeap() {
+        SQueue queue(priorityFn1, MAXHEAP, SKEW);
+        const int numNodes = 500000;
+        Post post(MINPOSTID, 100, 1, 1, 5);
+        nodeid_t chain = NULLNODE;
+        for (int i = 0; i < numNodes; i++) {
+            nodeid_t node = queue.m_pool->allocate(post);
+            queue.m_pool->node(node).m_key = priorityFn1(post);
+            queue.m_pool->node(node).m_left = chain; // equal priorities keep heap order valid
+            chain = node;
+        }
+        queue.m_heap = chain;
+        queue.m_size = numNodes;
+        SQueue copyQueue(queue);
+        copyQueue.setStructure(LEFTIST);
+        copyQueue.finishRebuild();
+        if (copyQueue.numPosts() != numNodes || !checkLeftist(copyQueue)) return false;
+        queue.clear();
+        copyQueue.clear();
+        return (queue.numPosts() == 0 && copyQueue.numPosts() == 0);
+    }
+
+    // Test batch insertion into a non-empty queue for both structures.
+    bool testInsertPosts() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        STRUCTURE structures[] = {SKEW, LEFTIST};
+        for (STRUCTURE structure : structures) {
+            SQueue queue(priorityFn2, MINHEAP, structure);
+            for (int i = 0; i < 20; i++) queue.insertPost(randomPost(randGen));
+            vector<Post> batch;
+            for (int i = 0; i < 500; i++) batch.push_back(randomPost(randGen));
+            if (queue.insertPosts(batch) != 500 || queue.numPosts() != 520) return false;
+            if (structure == LEFTIST && !checkLeftist(queue)) return false;
+            vector<int> priorities;
+            while (queue.numPosts() > 0) {
+                priorities.push_back(priorityFn2(queue.getNextPost()));
+            }
+            if (!checkRemovalOrder(priorities, true)) return false;
+        }
+        return true;
+    }
+
+    // Test that priorities are computed once per insert and once per node
+    // on a priority change, and never while popping.
+    bool testCachedPriorities() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue(countingPriorityFn, MAXHEAP, LEFTIST);
+        const int numNodes = 300;
+        priorityCalls = 0;
+        for (int i = 0; i < numNodes; i++) {
+            queue.insertPost(randomPost(randGen));
+        }
+        if (priorityCalls != numNodes) return false;
+        queue.setStructure(SKEW);
+        SQueue copyQueue(queue);
+        vector<int> priorities;
+        while (copyQueue.numPosts() > 0) {
+            priorities.push_back(priorityFn1(copyQueue.getNextPost()));
+        }
+        if (priorityCalls != numNodes || !checkRemovalOrder(priorities, false)) return false;
+        queue.setPriorityFn(countingPriorityFn, MINHEAP);
+        queue.finishRebuild();
+        return (priorityCalls == 2 * numNodes);
+    }
+
+    // Helper: Pop a BasicSQueue and an SQueue filled with the same posts
+    // and check that they return the same post IDs in the same order.
+    template <class Queue>
+    bool sameAsSQueue(Queue& basic, SQueue& queue, Random& randGen) {
+        vector<Post> batch;
+        for (int i = 0; i < 300; i++) {
+            Post post = randomPost(randGen);
+            basic.insertPost(post);
+            queue.insertPost(post);
+            batch.push_back(randomPost(randGen));
+        }
+        basic.insertPosts(batch.begin(), batch.end());
+        queue.insertPosts(batch);
+        Queue copy(basic);
+        if (copy.numPosts() != queue.numPosts()) return false;
+        while (queue.numPosts() > 0) {
+            if (copy.getNextPost().getPostID() != queue.getNextPost().getPostID()) return false;
+        }
+        return (copy.numPosts() == 0);
+    }
+
+    // Test that all four compile-time configurations match SQueue exactly,
+    // then moves and merges with a functor that has state.
+    bool testBasicSQueue() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        BasicSQueue<PriorityFnPtr<priorityFn2>, MINHEAP, SKEW> minSkew;
+        BasicSQueue<PriorityFnPtr<priorityFn2>, MINHEAP, LEFTIST> minLeftist;
+        BasicSQueue<PriorityFnPtr<priorityFn1>, MAXHEAP, SKEW> maxSkew;
+        BasicSQueue<PriorityFnPtr<priorityFn1>, MAXHEAP, LEFTIST> maxLeftist;
+        BasicSQueue<PriorityFnPtr<priorityFn1>, MAXHEAP, PAIRING> maxPairing;
+        SQueue queue1(priorityFn2, MINHEAP, SKEW);
+        SQueue queue2(priorityFn2, MINHEAP, LEFTIST);
+        SQueue queue3(priorityFn1, MAXHEAP, SKEW);
+        SQueue queue4(priorityFn1, MAXHEAP, LEFTIST);
+        SQueue queue5(priorityFn1, MAXHEAP, PAIRING);
+        if (!(sameAsSQueue(minSkew, queue1, randGen) &&
+              sameAsSQueue(minLeftist, queue2, randGen) &&
+              sameAsSQueue(maxSkew, queue3, randGen) &&
+              sameAsSQueue(maxLeftist, queue4, randGen) &&
+              sameAsSQueue(maxPairing, queue5, randGen))) return false;
+        typedef BasicSQueue<ScaledPriority, MAXHEAP, LEFTIST> ScaledQueue;
+        ScaledQueue scaled1(ScaledPriority{1}), scaled2(ScaledPriority{2}), scaled3(ScaledPriority{1});
+        for (int i = 0; i < 50; i++) {
+            scaled1.insertPost(randomPost(randGen));
+            scaled2.insertPost(randomPost(randGen));
+            scaled3.insertPost(randomPost(randGen));
+        }
+        try {
+            scaled1.mergeWithQueue(scaled2);
+            return false;
+        } catch (const domain_error&) {}
+        if (scaled1.numPosts() != 50 || scaled2.numPosts() != 50) return false;
+        scaled1.mergeWithQueue(scaled3);
+        if (scaled1.numPosts() != 100 || scaled3.numPosts() != 0) return false;
+        ScaledQueue moved(std::move(scaled1));
+        if (moved.numPosts() != 100 || scaled1.numPosts() != 0 || scaled1.getPool()) return false;
+        scaled1.insertPost(randomPost(randGen)); // the moved-from queue keeps working
+        scaled2 = std::move(moved);
+        if (scaled2.numPosts() != 100 || scaled2.getPriorityFn().m_scale != 1) return false;
+        int last = INT_MAX;
+        while (scaled2.numPosts() > 0) {
+            Post post = scaled2.getNextPost();
+            if (priorityFn1(post) > last) return false;
+            last = priorityFn1(post);
+        }
+        return (scaled1.numPosts() == 1);
+    }
+
+    // Test move construction and assignment, including reuse of a
+    // moved-from queue and a vector of queues growing.
+    bool testMoveSemantics() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue1(priorityFn1, MAXHEAP, LEFTIST);
+        for (int i = 0; i < 100; i++) queue1.insertPost(randomPost(randGen));
+        PostPool* pool = queue1.m_pool.get();
+        SQueue queue2(std::move(queue1));
+        if (queue2.m_pool.get() != pool || queue2.numPosts() != 100) return false;
+        if (queue1.numPosts() != 0 || queue1.m_heap != NULLNODE) return false;
+        // The moved-from queue keeps working
+        queue1.insertPost(randomPost(randGen));
+        if (queue1.numPosts() != 1) return false;
+        SQueue queue3(priorityFn2, MINHEAP, SKEW);
+        queue3.insertPost(randomPost(randGen));
+        queue3 = std::move(queue2);
+        if (queue3.m_pool.get() != pool || queue3.getHeapType() != MAXHEAP || queue2.numPosts() != 0) return false;
+        // Move assignment into a queue on a shared pool gives its nodes back
+        shared_ptr<PostPool> shared = make_shared<PostPool>();
+        SQueue queue4(priorityFn2, MINHEAP, BUCKET, shared);
+        SQueue queue5(priorityFn2, MINHEAP, DARY, shared);
+        for (int i = 0; i < 50; i++) {
+            queue4.insertPost(randomPost(randGen));
+            queue5.insertPost(randomPost(randGen));
+        }
+        int numFree = shared->numFree() + queue4.numPosts();
+        queue4 = std::move(queue3);
+        if (shared->numFree() != numFree || queue4.numPosts() != 100) return false;
+        numFree += queue5.numPosts();
+        queue5 = SQueue(priorityFn1, MAXHEAP, SKEW);
+        if (shared->numFree() != numFree || queue5.numPosts() != 0) return false;
+        vector<SQueue> queues;
+        for (int i = 0; i < 20; i++) {
+            queues.push_back(SQueue(priorityFn1, MAXHEAP, SKEW));
+            queues.back().insertPost(randomPost(randGen));
+            if (i == 0) pool = queues.back().m_pool.get();
+        }
+        return (queues[0].m_pool.get() == pool);
+    }
+
+    // Test the non-throwing pops on empty and non-empty queues.
+    bool testTryGetNextPost() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue(priorityFn2, MINHEAP, SKEW);
+        Post post;
+        if (queue.tryGetNextPost() || queue.tryGetNextPost(post)) return false;
+        for (int i = 0; i < 50; i++) queue.insertPost(randomPost(randGen));
+        vector<int> priorities;
+        while (optional<Post> next = queue.tryGetNextPost()) {
+            priorities.push_back(priorityFn2(*next));
+            if (queue.tryGetNextPost(post)) {
+                priorities.push_back(priorityFn2(post));
+            }
+        }
+        return (priorities.size() == 50 && checkRemovalOrder(priorities, true));
+    }
+
+    // Test building posts in place, including the invalid-post path.
+    bool testEmplacePost() {
+        SQueue queue(priorityFn1, MAXHEAP, LEFTIST);
+        SQueue zeroQueue(rejectAllFn, MAXHEAP, LEFTIST);
+        if (zeroQueue.emplacePost(MINPOSTID, 10, 1, 1, 1)) return false;
+        if (zeroQueue.numPosts() != 0 || zeroQueue.m_pool->numFree() != zeroQueue.m_pool->capacity()) return false;
+        for (int i = 0; i < 10; i++) {
+            if (!queue.emplacePost(MINPOSTID + i, i * 10, 1, 1, 1)) return false;
+        }
+        Post top = queue.getNextPost();
+        if (top.getPostID() != MINPOSTID + 9 || top.getNumLikes() != 90 || queue.numPosts() != 9) return false;
+        // Out of range fields get the defaults of the Post constructor
+        SQueue idQueue(postIdPriority, MAXHEAP, LEFTIST);
+        Post expected(0, MAXLIKES + 1, 0, MAXTIME + 1, 0);
+        idQueue.emplacePost(0, MAXLIKES + 1, 0, MAXTIME + 1, 0);
+        Post packed = idQueue.getNextPost();
+        return (packed.getPostID() == expected.getPostID() && packed.getNumLikes() == expected.getNumLikes() &&
+                packed.getConnectLevel() == expected.getConnectLevel() &&
+                packed.getPostTime() == expected.getPostTime() &&
+                packed.getInterestLevel() == expected.getInterestLevel());
+    }
+
+    // Test the node size and that packing keeps every field at its bounds.
+    bool testCompactNodes() {
+        if (sizeof(PostNode) > 24) return false;
+        Post posts[] = {Post(MAXPOSTID, MAXLIKES, MAXCONLEVEL, MAXTIME, MAXINTERESTLEVEL),
+                        Post(MINPOSTID, MINLIKES, MINCONLEVEL, MINTIME, MININTERESTLEVEL),
+                        Post()};
+        for (const Post& post : posts) {
+            PostNode node;
+            node.setPost(post);
+            Post copy = node.getPost();
+            if (copy.getPostID() != post.getPostID() || node.getPostID() != post.getPostID() ||
+                copy.getNumLikes() != post.getNumLikes() ||
+                copy.getConnectLevel() != post.getConnectLevel() ||
+                copy.getPostTime() != post.getPostTime() ||
+                copy.getInterestLevel() != post.getInterestLevel()) return false;
+        }
+        return true;
+    }
+
+    // Test BUCKET order against LEFTIST, plus merge and copy of bucket queues.
+    bool testBucketStructure() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue bucket(priorityFn1, MAXHEAP, BUCKET);
+        SQueue leftist(priorityFn1, MAXHEAP, LEFTIST);
+        SQueue other(priorityFn1, MAXHEAP, BUCKET);
+        bucket.setKeyRange(1, 510);
+        other.setKeyRange(1, 510);
+        for (int i = 0; i < 300; i++) {
+            Post post = randomPost(randGen);
+            bucket.insertPost(post);
+            leftist.insertPost(post);
+            Post post2 = randomPost(randGen);
+            other.insertPost(post2);
+            leftist.insertPost(post2);
+        }
+        if (bucket.m_buckets.numNodes() != 300 || bucket.m_heap != NULLNODE) return false;
+        bucket.mergeWithQueue(other);
+        if (other.numPosts() != 0 || bucket.numPosts() != 600) return false;
+        SQueue copy(bucket);
+        while (leftist.numPosts() > 0) {
+            int expected = priorityFn1(leftist.getNextPost());
+            if (priorityFn1(bucket.getNextPost()) != expected) return false;
+            if (priorityFn1(copy.getNextPost()) != expected) return false;
+        }
+        return (bucket.numPosts() == 0 && copy.numPosts() == 0);
+    }
+
+    // Test keys outside the declared range, structure switches and bad ranges.
+    bool testBucketFallback() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue(priorityFn1, MINHEAP, LEFTIST);
+        try {
+            queue.setKeyRange(10, 1);
+            return false;
+        } catch (const domain_error&) {}
+        queue.setKeyRange(100, 300);
+        for (int i = 0; i < 200; i++) queue.insertPost(randomPost(randGen));
+        queue.setStructure(BUCKET);
+        queue.finishRebuild();
+        if (queue.m_buckets.empty() || queue.m_heap == NULLNODE) return false;
+        if (queue.numPosts() != 200 || queue.m_buckets.numNodes() >= 200) return false;
+        vector<int> priorities;
+        for (int i = 0; i < 100; i++) priorities.push_back(priorityFn1(queue.getNextPost()));
+        queue.setStructure(SKEW);
+        queue.finishRebuild();
+        if (!queue.m_buckets.empty() || queue.numPosts() != 100) return false;
+        while (queue.numPosts() > 0) priorities.push_back(priorityFn1(queue.getNextPost()));
+        return checkRemovalOrder(priorities, true);
+    }
+
+    // Test PAIRING and DARY against LEFTIST through inserts, pops, merges,
+    // copies and structure switches.
+    bool testPairingAndDary() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        STRUCTURE structures[] = {PAIRING, DARY};
+        for (STRUCTURE structure : structures) {
+            SQueue queue(priorityFn2, MINHEAP, structure);
+            SQueue other(priorityFn2, MINHEAP, structure);
+            SQueue leftist(priorityFn2, MINHEAP, LEFTIST);
+            for (int i = 0; i < 200; i++) {
+                Post post = randomPost(randGen);
+                queue.insertPost(post);
+                leftist.insertPost(post);
+            }
+            // Pop a few so the pairing heap has a multi-level shape.
+            for (int i = 0; i < 20; i++) {
+                if (priorityFn2(queue.getNextPost()) != priorityFn2(leftist.getNextPost())) return false;
+            }
+            vector<Post> batch;
+            for (int i = 0; i < 300; i++) batch.push_back(randomPost(randGen));
+            other.insertPosts(batch);
+            leftist.insertPosts(batch);
+            queue.mergeWithQueue(other);
+            if (other.numPosts() != 0 || queue.numPosts() != 480) return false;
+            if (structure == DARY && (queue.m_heap != NULLNODE || queue.m_dary.numNodes() != 480)) return false;
+            SQueue copy(queue);
+            copy.setStructure(structure == PAIRING ? DARY : PAIRING);
+            while (leftist.numPosts() > 0) {
+                int expected = priorityFn2(leftist.getNextPost());
+                if (priorityFn2(queue.getNextPost()) != expected) return false;
+                if (priorityFn2(copy.getNextPost()) != expected) return false;
+            }
+            if (queue.numPosts() != 0 || copy.numPosts() != 0) return false;
+        }
+        return true;
+    }
+
+    // Test that setPriorityFn/setStructure defer the rebuild, inserts
+    // advance it by the budget and the first pop finishes it.
+    bool testLazyRebuild() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue(countingPriorityFn, MAXHEAP, LEFTIST);
+        const int numNodes = 400;
+        for (int i = 0; i < numNodes; i++) queue.insertPost(randomPost(randGen));
+        priorityCalls = 0;
+        queue.setPriorityFn(priorityFn2, MINHEAP);
+        queue.setStructure(SKEW);
+        queue.setPriorityFn(countingPriorityFn, MINHEAP);
+        queue.setStructure(PAIRING);
+        if (priorityCalls != 0 || !queue.rebuildPending() || queue.numPosts() != numNodes) return false;
+        queue.setRebuildBudget(10);
+        for (int i = 0; i < 5; i++) queue.insertPost(randomPost(randGen));
+        // 5 inserted posts and 5 steps of at most 10 nodes
+        if (priorityCalls != 5 + 50 || !queue.rebuildPending()) return false;
+        SQueue copy(queue);
+        vector<int> priorities;
+        priorities.push_back(priorityFn1(queue.getNextPost()));
+        if (queue.rebuildPending() || priorityCalls != 5 + numNodes) return false;
+        while (queue.numPosts() > 0) priorities.push_back(priorityFn1(queue.getNextPost()));
+        if (priorities.size() != numNodes + 5 || !checkRemovalOrder(priorities, true)) return false;
+        priorities.clear();
+        while (copy.numPosts() > 0) priorities.push_back(priorityFn1(copy.getNextPost()));
+        if (priorities.size() != numNodes + 5 || !checkRemovalOrder(priorities, true)) return false;
+        // Printing during a pending rebuild shows the new keys
+        SQueue printed(priorityFn1, MAXHEAP, LEFTIST);
+        vector<int> expected;
+        for (int i = 0; i < 50; i++) {
+            Post post = randomPost(randGen);
+            if (printed.insertPost(post)) expected.push_back(priorityFn2(post));
+        }
+        printed.setPriorityFn(priorityFn2, MINHEAP);
+        if (!printed.rebuildPending()) return false;
+        ostringstream out;
+        streambuf* saved = cout.rdbuf(out.rdbuf());
+        printed.printPostsQueue();
+        cout.rdbuf(saved);
+        istringstream lines(out.str());
+        string line;
+        vector<int> keys;
+        while (getline(lines, line)) {
+            if (!line.empty() && line[0] == '[') keys.push_back(atoi(line.c_str() + 1));
+        }
+        sort(keys.begin(), keys.end());
+        sort(expected.begin(), expected.end());
+        return (keys == expected);
+    }
+
+    // Test removes and updates through handles and post IDs against a
+    // map of the posts that should be left, for every tree structure.
+    bool testRemoveAndUpdate() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        Random likesGen(MINLIKES, MAXLIKES);
+        STRUCTURE structures[] = {SKEW, LEFTIST, PAIRING};
+        for (STRUCTURE structure : structures) {
+            SQueue queue(priorityFn1, MAXHEAP, structure);
+            map<int, Post> expected;
+            vector<PostHandle> handles;
+            for (int i = 0; i < 300; i++) {
+                Post post = randomPost(randGen);
+                post = Post(MINPOSTID + i, post.getNumLikes(), post.getConnectLevel(),
+                            post.getPostTime(), post.getInterestLevel());
+                handles.push_back(queue.insertPost(post));
+                expected[post.getPostID()] = post;
+            }
+            // Pop a few so the pairing heap has siblings to cut between.
+            for (int i = 0; i < 10; i++) expected.erase(queue.getNextPost().getPostID());
+            for (int i = 0; i < 300; i += 3) {
+                bool queued = (expected.erase(handles[i].getPostID()) == 1);
+                if (queue.removePost(handles[i]) != queued) return false;
+                if (queue.removePost(handles[i])) return false;
+            }
+            for (int i = 1; i < 300; i += 5) {
+                int id = MINPOSTID + i;
+                if (expected.count(id) == 0) continue;
+                const Post& old = expected[id];
+                Post updated(id, likesGen.getRandNum(), old.getConnectLevel(), old.getPostTime(), old.getInterestLevel());
+                if (!queue.updateLikes(id, updated.getNumLikes())) return false;
+                expected[id] = updated;
+            }
+            for (int i = 2; i < 300; i += 7) {
+                int id = MINPOSTID + i;
+                if (queue.removePost(id) != (expected.erase(id) == 1)) return false;
+            }
+            if (queue.numPosts() != (int)expected.size() || !checkParents(queue)) return false;
+            if (structure == LEFTIST && !checkLeftist(queue)) return false;
+            vector<int> priorities;
+            while (queue.numPosts() > 0) {
+                Post post = queue.getNextPost();
+                map<int, Post>::iterator it = expected.find(post.getPostID());
+                if (it == expected.end() || it->second.getNumLikes() != post.getNumLikes()) return false;
+                expected.erase(it);
+                priorities.push_back(priorityFn1(post));
+            }
+            if (!expected.empty() || !checkRemovalOrder(priorities, false)) return false;
+        }
+        SQueue bucket(priorityFn1, MAXHEAP, BUCKET);
+        try {
+            bucket.removePost(MINPOSTID);
+            return false;
+        } catch (const domain_error&) {}
+        // A live post keyed 0 by a new priority function keeps its handle
+        SQueue rekeyed(priorityFn1, MAXHEAP, SKEW);
+        PostHandle rekeyedHandle = rekeyed.insertPost(Post(MINPOSTID, 10, 1, 1, 1));
+        rekeyed.insertPost(Post(MINPOSTID + 1, 20, 1, 1, 1));
+        rekeyed.setPriorityFn(rejectAllFn, MAXHEAP);
+        if (!rekeyed.removePost(rekeyedHandle) || rekeyed.numPosts() != 1) return false;
+        if (rekeyed.removePost(rekeyedHandle)) return false;
+        // A handle never reaches another queue on the same pool
+        shared_ptr<PostPool> shared = make_shared<PostPool>();
+        SQueue queue1(priorityFn1, MAXHEAP, LEFTIST, shared);
+        SQueue queue2(priorityFn1, MAXHEAP, LEFTIST, shared);
+        vector<PostHandle> handles;
+        for (int i = 0; i < 50; i++) {
+            queue1.insertPost(randomPost(randGen));
+            handles.push_back(queue2.insertPost(randomPost(randGen)));
+        }
+        for (PostHandle handle : handles) {
+            if (queue1.removePost(handle) || queue1.updatePost(handle, randomPost(randGen))) return false;
+        }
+        if (queue1.numPosts() != 50 || queue2.numPosts() != 50) return false;
+        for (PostHandle handle : handles) {
+            if (!queue2.removePost(handle)) return false;
+        }
+        return (queue2.numPosts() == 0 && checkParents(queue1));
+    }
+
+    // Test that a bounded queue keeps the best posts in fixed memory,
+    // including after a merge and when the capacity shrinks.
+    bool testBoundedQueue() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        const int capacity = 50;
+        SQueue queue(priorityFn1, MAXHEAP, LEFTIST);
+        SQueue other(priorityFn1, MAXHEAP, SKEW);
+        queue.setCapacity(capacity);
+        other.setStructure(LEFTIST);
+        other.setCapacity(capacity);
+        vector<int> keys;
+        for (int i = 0; i < 1000; i++) {
+            Post post = randomPost(randGen);
+            keys.push_back(priorityFn1(post));
+            PostHandle handle = (i % 2 ? queue.insertPost(post) : other.insertPost(post));
+            if (handle && priorityFn1(post) == 0) return false;
+        }
+        if (queue.numPosts() != capacity || queue.m_pool->capacity() > capacity) return false;
+        Post worst(MINPOSTID, MINLIKES, 1, 1, MININTERESTLEVEL);
+        if (queue.insertPost(worst) || queue.numPosts() != capacity) return false;
+        try {
+            queue.setStructure(BUCKET);
+            return false;
+        } catch (const domain_error&) {}
+        queue.mergeWithQueue(other);
+        if (queue.numPosts() != capacity || !checkLeftist(queue) || !checkParents(queue)) return false;
+        SQueue copy(queue);
+        copy.setCapacity(20);
+        sort(keys.begin(), keys.end(), greater<int>());
+        for (int i = 0; i < capacity; i++) {
+            if (priorityFn1(queue.getNextPost()) != keys[i]) return false;
+            if (i < 20 && priorityFn1(copy.getNextPost()) != keys[i]) return false;
+        }
+        return (queue.numPosts() == 0 && copy.numPosts() == 0);
+    }
+
+    // Test evicting from a full bounded queue while a rebuild is pending
+    // and its worst post still sits in a stale subtree.
+    bool testBoundedEvictDuringRebuild() {
+        SQueue queue(postIdPriority, MAXHEAP, LEFTIST);
+        queue.setRebuildBudget(0);
+        queue.setCapacity(3);
+        for (int i = 1; i <= 3; i++) queue.insertPost(Post(MINPOSTID + i, 1, 1, 1, 1));
+        queue.setStructure(SKEW);
+        queue.rebuildStep(2);
+        if (!queue.insertPost(Post(MINPOSTID + 10, 1, 1, 1, 1))) return false;
+        if (queue.numPosts() != 3 || queue.rebuildPending() || !checkParents(queue)) return false;
+        int expected[] = {MINPOSTID + 10, MINPOSTID + 3, MINPOSTID + 2};
+        for (int id : expected) {
+            if (queue.getNextPost().getPostID() != id) return false;
+        }
+        return (queue.numPosts() == 0 && queue.m_pool->capacity() <= 4);
+    }
+
+    // Test peek, topK and the ordered iterator against the pop order for
+    // every structure, and that none of them change the queue.
+    bool testPeekAndOrderedIterator() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        STRUCTURE structures[] = {SKEW, LEFTIST, PAIRING, BUCKET, DARY};
+        HEAPTYPE heapTypes[] = {MINHEAP, MAXHEAP};
+        for (STRUCTURE structure : structures) {
+            for (HEAPTYPE heapType : heapTypes) {
+                SQueue queue(priorityFn1, heapType, structure);
+                if (queue.tryPeek() || queue.topK(5).size() != 0 || queue.orderedPosts().hasNext()) return false;
+                // A narrow range puts some keys in the fallback heap, a wide
+                // one leaves long runs of empty buckets
+                if (structure == BUCKET) queue.setKeyRange(100, heapType == MINHEAP ? 300 : 10000);
+                for (int i = 0; i < 300; i++) queue.insertPost(randomPost(randGen));
+                // Pop a few so the pairing heap has a multi-level shape.
+                for (int i = 0; i < 20; i++) queue.getNextPost();
+                vector<Post> top = queue.topK(50);
+                vector<int> ordered;
+                OrderedIterator it = queue.orderedPosts();
+                while (it.hasNext()) ordered.push_back(priorityFn1(it.next()));
+                try {
+                    it.next();
+                    return false;
+                } catch (const out_of_range&) {}
+                if (top.size() != 50 || ordered.size() != 280 || queue.numPosts() != 280) return false;
+                for (size_t i = 0; i < ordered.size(); i++) {
+                    int expected = priorityFn1(queue.peek());
+                    Post post = queue.getNextPost();
+                    if (priorityFn1(post) != expected || ordered[i] != expected) return false;
+                    if (i < top.size() && priorityFn1(top[i]) != expected) return false;
+                }
+                if (queue.numPosts() != 0) return false;
+            }
+        }
+        return true;
+    }
+
+    // Test batched drains against single pops for every structure, with
+    // an index and a capacity, and that the nodes go back to the pool.
+    bool testGetNextPosts() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        STRUCTURE structures[] = {SKEW, LEFTIST, PAIRING, BUCKET, DARY};
+        for (STRUCTURE structure : structures) {
+            SQueue queue(priorityFn2, MINHEAP, structure);
+            if (structure == BUCKET) queue.setKeyRange(2, 30);
+            if (structure == LEFTIST) queue.setCapacity(250);
+            vector<PostHandle> handles;
+            for (int i = 0; i < 300; i++) {
+                Post post = randomPost(randGen);
+                post = Post(MINPOSTID + i, post.getNumLikes(), post.getConnectLevel(),
+                            post.getPostTime(), post.getInterestLevel());
+                handles.push_back(queue.insertPost(post));
+            }
+            if (structure != BUCKET && structure != DARY) queue.findPost(MINPOSTID);
+            SQueue copy(queue);
+            int numPosts = queue.numPosts();
+            vector<Post> posts;
+            Post buffer[40];
+            if (queue.getNextPosts(0, posts) != 0 || !posts.empty()) return false;
+            int drained = 0;
+            for (int k = 1; drained < numPosts; k += 7) {
+                int freeBefore = queue.m_pool->numFree();
+                int count = (k % 2 ? queue.getNextPosts(k, posts) : queue.getNextPosts(min(k, 40), buffer));
+                if (!(k % 2)) posts.insert(posts.end(), buffer, buffer + count);
+                drained += count;
+                if (queue.numPosts() != numPosts - drained) return false;
+                if (queue.m_pool->numFree() != freeBefore + count) return false;
+                if (structure == LEFTIST && !checkLeftist(queue)) return false;
+                if (structure != BUCKET && structure != DARY && !checkParents(queue)) return false;
+            }
+            if ((int)posts.size() != numPosts || queue.getNextPosts(5, posts) != 0) return false;
+            for (const Post& post : posts) {
+                if (priorityFn2(post) != priorityFn2(copy.getNextPost())) return false;
+            }
+            if (structure != BUCKET && structure != DARY) {
+                if (queue.removePost(handles[0]) || queue.removePost(MINPOSTID + 1)) return false;
+            }
+        }
+        return true;
+    }
+
+    // Test the stats counters when they are compiled in, and that they
+    // stay at zero when they are not.
+    bool testStats() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        SQueue queue(priorityFn1, MAXHEAP, SKEW);
+        SQueue other(priorityFn1, MAXHEAP, SKEW);
+        for (int i = 0; i < 200; i++) queue.insertPost(Post(MINPOSTID + i, i, 1, 1, 1));
+        for (int i = 0; i < 100; i++) other.insertPost(randomPost(randGen));
+        queue.mergeWithQueue(other);
+        for (int i = 0; i < 50; i++) queue.getNextPost();
+        vector<Post> posts;
+        queue.getNextPosts(10, posts);
+        queue.setPriorityFn(priorityFn2, MINHEAP);
+        queue.finishRebuild();
+        SQueueStats stats = queue.stats();
+        if (!SQueue::statsEnabled()) {
+            return (stats.m_priorityCalls == 0 && stats.m_insert.m_count == 0 && stats.m_merges == 0);
+        }
+        if (stats.m_insert.m_count != 200 || stats.m_pop.m_count != 51 || stats.m_merge.m_count != 1) return false;
+        // 200 inserts plus the 240 posts rekeyed by the rebuild
+        if (stats.m_priorityCalls != 200 + 240 || stats.m_allocations != 200 || stats.m_rebuilds != 1) return false;
+        if (stats.m_merges == 0 || stats.m_comparisons < stats.m_mergePath) return false;
+        if (stats.m_childSwaps != stats.m_mergePath || stats.m_maxMergePath < stats.meanMergePath()) return false;
+        uint64_t binned = 0;
+        for (int i = 0; i < LATENCYBINS; i++) binned += stats.m_insert.m_bins[i];
+        if (binned != 200 || stats.m_insert.m_maxNs == 0 || stats.m_insert.meanNs() > stats.m_insert.m_maxNs) return false;
+        if (other.stats().m_insert.m_count != 100) return false;
+        queue.resetStats();
+        stats = queue.stats();
+        return (stats.m_priorityCalls == 0 && stats.m_pop.m_count == 0 && stats.m_maxMergePath == 0);
+    }
+
+    // Test that a snapshot reloads into the same heap for every structure,
+    // that the mapped view walks it in order, and that damage is caught.
+    bool testSnapshot() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        const string path = "mytest_snapshot.bin";
+        STRUCTURE structures[] = {SKEW, LEFTIST, PAIRING, BUCKET, DARY};
+        for (STRUCTURE structure : structures) {
+            SQueue queue(priorityFn1, structure == SKEW ? MAXHEAP : MINHEAP, structure);
+            if (structure == BUCKET) queue.setKeyRange(100, 300);
+            if (structure == LEFTIST) queue.setCapacity(250);
+            for (int i = 0; i < 300; i++) queue.insertPost(randomPost(randGen));
+            // Pop a few so the pairing heap has a multi-level shape.
+            for (int i = 0; i < 20; i++) queue.getNextPost();
+            stringstream stream;
+            queue.saveSnapshot(stream);
+            queue.saveSnapshot(path);
+            SQueue loaded(priorityFn1, MAXHEAP, SKEW);
+            loaded.insertPost(randomPost(randGen));
+            loaded.loadSnapshot(stream);
+            if (loaded.numPosts() != queue.numPosts() || loaded.getStructure() != structure ||
+                loaded.getHeapType() != queue.getHeapType() || loaded.getCapacity() != queue.getCapacity()) return false;
+            if (structure == LEFTIST && !checkLeftist(loaded)) return false;
+            if (structure != BUCKET && structure != DARY && !checkParents(loaded)) return false;
+            vector<int> ordered;
+            {
+                MappedSQueue mapped(path);
+                if (mapped.numPosts() != queue.numPosts() || mapped.peek().getPostID() != queue.peek().getPostID()) return false;
+                MappedIterator it = mapped.orderedPosts();
+                while (it.hasNext()) ordered.push_back(priorityFn1(it.next()));
+            }
+            if ((int)ordered.size() != queue.numPosts()) return false;
+            // The restored heap has the same shape, so even ties pop alike
+            for (size_t i = 0; i < ordered.size(); i++) {
+                Post post = queue.getNextPost();
+                if (loaded.getNextPost().getPostID() != post.getPostID() || ordered[i] != priorityFn1(post)) return false;
+            }
+        }
+        SQueue empty(priorityFn1, MINHEAP, SKEW);
+        empty.saveSnapshot(path);
+        {
+            MappedSQueue mapped(path);
+            if (mapped.tryPeek() || mapped.orderedPosts().hasNext()) return false;
+        }
+        SQueue queue(priorityFn1, MINHEAP, LEFTIST);
+        for (int i = 0; i < 50; i++) queue.insertPost(randomPost(randGen));
+        stringstream stream;
+        queue.saveSnapshot(stream);
+        string bytes = stream.str();
+        bytes[bytes.size() - 20] ^= 1;
+        stringstream damaged(bytes);
+        stringstream truncated(bytes.substr(0, bytes.size() - 8));
+        // A flipped heap type is caught by the checksum
+        string flipped = stream.str();
+        flipped[offsetof(SnapshotHeader, m_heapType)] ^= 1;
+        stringstream flippedHeap(flipped);
+        // A bounded BUCKET header is rejected even with a matching checksum
+        SnapshotHeader header;
+        memcpy(&header, bytes.data(), sizeof(header));
+        header.m_structure = BUCKET;
+        header.m_capacity = 100;
+        header.m_numNodes = 0;
+        header.m_checksum = SnapshotFormat::checksum(header, nullptr, 0);
+        stringstream boundedBucket(string((const char*)&header, sizeof(header)));
+        int errors = 0;
+        try { queue.loadSnapshot(damaged); } catch (const domain_error&) { errors++; }
+        try { queue.loadSnapshot(truncated); } catch (const domain_error&) { errors++; }
+        try { queue.loadSnapshot(flippedHeap); } catch (const domain_error&) { errors++; }
+        try { queue.loadSnapshot(boundedBucket); } catch (const domain_error&) { errors++; }
+        try { MappedSQueue missing("no_such_snapshot.bin"); } catch (const domain_error&) { errors++; }
+        remove(path.c_str());
+        // A failed load leaves the queue alone
+        return (errors == 5 && queue.numPosts() == 50);
+    }
+
+    // Test CSV and binary loading against direct inserts, with chunks and
+    // batches small enough that lines and records straddle chunk ends.
+    bool testPostLoader() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        vector<Post> posts;
+        for (int i = 0; i < 2000; i++) posts.push_back(randomPost(randGen));
+        stringstream csv;
+        stringstream binary;
+        csv << "ID,likes,connectLevel,postTime,interestLevel\r\n";
+        for (size_t i = 0; i < posts.size(); i++) {
+            const Post& post = posts[i];
+            int fields[5] = {post.getPostID(), post.getNumLikes(), post.getConnectLevel(),
+                             post.getPostTime(), post.getInterestLevel()};
+            csv << fields[0] << ", " << fields[1] << "," << fields[2] << "," << fields[3] << "," << fields[4]
+                << (i % 3 ? "\n" : "\r\n");
+            if (i % 500 == 0) csv << "\n" << MINPOSTID << ",600,1,1,1\n1,2,3\nnot a post\n";
+            binary.write((const char*)fields, sizeof(fields));
+        }
+        csv << MAXPOSTID << ",1,1,1,1"; // no final newline
+        posts.push_back(Post(MAXPOSTID, 1, 1, 1, 1));
+        SQueue expected(priorityFn1, MAXHEAP, LEFTIST);
+        int accepted = expected.insertPosts(posts);
+        SQueue fromCsv(priorityFn1, MAXHEAP, LEFTIST);
+        SQueue fromBinary(priorityFn1, MAXHEAP, LEFTIST);
+        LoadStats csvStats = PostLoader(CSVPOSTS, 64, 100).load(csv, fromCsv);
+        LoadStats binaryStats = PostLoader(BINARYPOSTS, 64, 100).load(binary, fromBinary);
+        if (csvStats.m_parsed != 2001 || csvStats.m_invalid != 12 || csvStats.m_inserted != accepted) return false;
+        if (binaryStats.m_parsed != 2000 || binaryStats.m_invalid != 0 || csvStats.postsPerSecond() <= 0) return false;
+        if (fromCsv.numPosts() != accepted || fromBinary.numPosts() != accepted - 1 || !checkLeftist(fromCsv)) return false;
+        fromBinary.insertPost(posts.back());
+        while (expected.numPosts() > 0) {
+            int key = priorityFn1(expected.getNextPost());
+            if (priorityFn1(fromCsv.getNextPost()) != key || priorityFn1(fromBinary.getNextPost()) != key) return false;
+        }
+        stringstream partial(string(30, '\0'));
+        try {
+            PostLoader(BINARYPOSTS).load(partial, fromBinary);
+            return false;
+        } catch (const domain_error&) {}
+        return (fromBinary.numPosts() == 0);
+    }
+
+    // Test mergeAll against a reference queue, on threads and with a
+    // bounded target, and that bad input is rejected before any merge.
+    bool testMergeAll() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        const int numQueues = 9;
+        SQueue target(priorityFn1, MINHEAP, LEFTIST);
+        SQueue reference(priorityFn1, MINHEAP, LEFTIST);
+        vector<unique_ptr<SQueue>> owned;
+        vector<SQueue*> queues;
+        for (int q = 0; q < numQueues; q++) {
+            owned.push_back(make_unique<SQueue>(priorityFn1, MINHEAP, LEFTIST));
+            queues.push_back(owned.back().get());
+            for (int i = 0; i < 2000; i++) {
+                Post post = randomPost(randGen);
+                queues[q]->insertPost(post);
+                reference.insertPost(post);
+            }
+        }
+        SQueue skew(priorityFn1, MINHEAP, SKEW);
+        vector<SQueue*> bad(queues);
+        bad.push_back(&skew);
+        vector<SQueue*> twice(queues);
+        twice.push_back(queues[0]);
+        int errors = 0;
+        try { target.mergeAll(bad); } catch (const domain_error&) { errors++; }
+        try { target.mergeAll(twice); } catch (const domain_error&) { errors++; }
+        if (errors != 2 || target.numPosts() != 0 || queues[0]->numPosts() != 2000) return false;
+        target.mergeAll(queues, 4);
+        for (SQueue* queue : queues) {
+            if (queue->numPosts() != 0 || queue->m_pool == target.m_pool) return false;
+        }
+        if (target.numPosts() != reference.numPosts() || !checkLeftist(target) || !checkParents(target)) return false;
+        while (reference.numPosts() > 0) {
+            if (priorityFn1(target.getNextPost()) != priorityFn1(reference.getNextPost())) return false;
+        }
+        // Sources with a small capacity must not trim on the way up
+        vector<int> keys;
+        target.setCapacity(50);
+        for (SQueue* queue : queues) {
+            queue->setCapacity(10);
+            for (int i = 0; i < 10; i++) {
+                Post post = randomPost(randGen);
+                queue->insertPost(post);
+                keys.push_back(priorityFn1(post));
+            }
+        }
+        target.mergeAll(queues);
+        sort(keys.begin(), keys.end());
+        if (target.numPosts() != 50 || queues[1]->getCapacity() != 10) return false;
+        for (int i = 0; i < 50; i++) {
+            if (priorityFn1(target.getNextPost()) != keys[i]) return false;
+        }
+        // A merge that throws midway still restores every capacity
+        target.clear();
+        for (SQueue* queue : queues) {
+            queue->insertPost(randomPost(randGen));
+            queue->setPriorityFn(throwingFn, MINHEAP); // rekeyed on the first merge
+        }
+        target.setPriorityFn(throwingFn, MINHEAP);
+        try {
+            target.mergeAll(queues);
+            return false;
+        } catch (const runtime_error&) {}
+        for (SQueue* queue : queues) {
+            if (queue->getCapacity() != 10) return false;
+        }
+        return (target.getCapacity() == 50);
+    }
+
+    // Test a rebuild finished on several threads: the leftist NPL and
+    // parent invariants hold, posts inserted while it was pending are kept
+    // and the pop order follows the new priority function.
+    bool testParallelRebuild() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        STRUCTURE structures[] = {LEFTIST, SKEW};
+        for (STRUCTURE structure : structures) {
+            SQueue queue(priorityFn1, MAXHEAP, structure);
+            queue.setRebuildThreads(4);
+            vector<int> keys;
+            for (int i = 0; i < MINPARALLELREBUILD + 5000; i++) {
+                Post post = randomPost(randGen);
+                queue.insertPost(post);
+                keys.push_back(priorityFn2(post));
+            }
+            queue.setRebuildBudget(0);
+            queue.setPriorityFn(priorityFn2, MINHEAP);
+            for (int i = 0; i < 100; i++) {
+                Post post = randomPost(randGen);
+                queue.insertPost(post);
+                keys.push_back(priorityFn2(post));
+            }
+            if (!queue.rebuildPending()) return false;
+            queue.finishRebuild();
+            if (queue.rebuildPending() || queue.numPosts() != (int)keys.size()) return false;
+            if (structure == LEFTIST && !checkLeftist(queue)) return false;
+            if (!checkParents(queue)) return false;
+            sort(keys.begin(), keys.end());
+            for (int key : keys) {
+                if (priorityFn2(queue.getNextPost()) != key) return false;
+            }
+        }
+        return true;
+    }
+
+    // Helper: Check the leftist NPL rule on a persistent tree.
+    bool checkPersistentLeftist(const PersistentSQueue& queue) {
+        vector<const PersistentSQueue::Node*> stack;
+        if (queue.m_root != nullptr) stack.push_back(queue.m_root);
+        while (!stack.empty()) {
+            const PersistentSQueue::Node* n = stack.back();
+            stack.pop_back();
+            int nplLeft = (n->m_left ? n->m_left->m_npl : 0);
+            int nplRight = (n->m_right ? n->m_right->m_npl : 0);
+            if (nplLeft < nplRight || n->m_npl != (n->m_right ? nplRight + 1 : 0)) return false;
+            if (n->m_left) stack.push_back(n->m_left);
+            if (n->m_right) stack.push_back(n->m_right);
+        }
+        return true;
+    }
+
+    // Test that a persistent copy shares the tree, that popping it leaves
+    // the original alone, a reader draining a snapshot while the writer
+    // keeps inserting, and the release of a long skew chain.
+    bool testPersistentSQueue() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        try {
+            PersistentSQueue bucket(priorityFn1, MINHEAP, BUCKET);
+            return false;
+        } catch (const domain_error&) {}
+        PersistentSQueue queue(priorityFn1, MINHEAP, LEFTIST);
+        vector<int> keys;
+        for (int i = 0; i < 2000; i++) {
+            Post post = randomPost(randGen);
+            queue.insertPost(post);
+            keys.push_back(priorityFn1(post));
+        }
+        sort(keys.begin(), keys.end());
+        PersistentSQueue snapshot(queue);
+        if (snapshot.m_root != queue.m_root || queue.m_root->m_refs != 2) return false;
+        for (int key : keys) {
+            if (priorityFn1(snapshot.getNextPost()) != key) return false;
+        }
+        if (snapshot.numPosts() != 0 || queue.numPosts() != 2000 || !checkPersistentLeftist(queue)) return false;
+        // The reader drains its snapshot while the writer changes the queue
+        PersistentSQueue reader(queue);
+        bool ordered = true;
+        thread readerThread([&reader, &keys, &ordered]() {
+            for (int key : keys) {
+                if (priorityFn1(reader.getNextPost()) != key) ordered = false;
+            }
+        });
+        for (int i = 0; i < 2000; i++) {
+            queue.insertPost(randomPost(randGen));
+            queue.getNextPost();
+        }
+        readerThread.join();
+        if (!ordered || queue.numPosts() != 2000 || !checkPersistentLeftist(queue)) return false;
+        queue.mergeWithQueue(queue);
+        queue.setPriorityFn(priorityFn2, MAXHEAP);
+        if (queue.numPosts() != 4000 || !checkPersistentLeftist(queue)) return false;
+        int last = priorityFn2(queue.getNextPost());
+        while (queue.numPosts() > 0) {
+            int key = priorityFn2(queue.getNextPost());
+            if (key > last) return false;
+            last = key;
+        }
+        // Rising ids in a MAXHEAP skew heap form a left chain
+        PersistentSQueue chain(postIdPriority, MAXHEAP, SKEW);
+        for (int id = MINPOSTID; id < MINPOSTID + 200000; id++) chain.insertPost(Post(id, 1, 1, 1, 1));
+        PersistentSQueue chainCopy(chain);
+        chain.clear();
+        return (chainCopy.numPosts() == 200000 && chainCopy.peek().getPostID() == MINPOSTID + 199999);
+    }
+
+    // Test pops alternating between two views of the same posts: each pop
+    // returns the best post of its view and removes it from the other one.
+    bool testMultiViewSQueue() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        MultiViewSQueue queue;
+        int errors = 0;
+        try { queue.insertPost(randomPost(randGen)); } catch (const domain_error&) { errors++; }
+        int likes = queue.addView(priorityFn1, MAXHEAP);
+        int recent = queue.addView(priorityFn2, MINHEAP);
+        try { queue.peek(2); } catch (const domain_error&) { errors++; }
+        if (errors != 2 || likes != 0 || recent != 1) return false;
+        vector<Post> remaining;
+        for (int i = 0; i < 1000; i++) {
+            Post post = randomPost(randGen);
+            if (queue.insertPost(post)) remaining.push_back(post);
+        }
+        if (queue.numPosts() != (int)remaining.size()) return false;
+        for (int i = 0; !remaining.empty(); i++) {
+            int view = i % 2;
+            prifn_t priFn = (view == likes ? priorityFn1 : priorityFn2);
+            Post post = queue.getNextPost(view);
+            size_t best = 0;
+            for (size_t j = 1; j < remaining.size(); j++) {
+                int key = priFn(remaining[j]);
+                if (view == likes ? key > priFn(remaining[best]) : key < priFn(remaining[best])) best = j;
+            }
+            if (priFn(post) != priFn(remaining[best])) return false;
+            size_t j = 0;
+            while (j < remaining.size() && (remaining[j].getPostID() != post.getPostID() ||
+                   priorityFn1(remaining[j]) != priorityFn1(post) || priorityFn2(remaining[j]) != priorityFn2(post))) j++;
+            if (j == remaining.size()) return false;
+            remaining.erase(remaining.begin() + j);
+            if (queue.numPosts() != (int)remaining.size()) return false;
+        }
+        if (queue.tryGetNextPost(recent) || queue.tryPeek(likes)) return false;
+        // A view added later ranks the queued posts and drops the rejected ones
+        for (int i = 0; i < 100; i++) queue.insertPost(randomPost(randGen));
+        queue.addView(rejectAllFn, MINHEAP);
+        return (queue.numPosts() == 0 && !queue.tryPeek(recent));
+    }
+
+    // Test every score kernel this CPU runs against LinearPriority::score,
+    // then bulk inserts and a rebuild scored in blocks instead of calling
+    // the priority function.
+    bool testBatchScoring() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        LinearPriority likes;
+        likes.m_likes = 1;
+        likes.m_interestLevel = 1;
+        likes.m_maxKey = 510;
+        LinearPriority narrow(likes);
+        narrow.m_minKey = 200;
+        narrow.m_maxKey = 300;
+        LinearPriority wrapping;
+        wrapping.m_postID = 123457;
+        wrapping.m_likes = -98765;
+        wrapping.m_postTime = 40000;
+        wrapping.m_bias = -7;
+        wrapping.m_minKey = INT_MIN;
+        LinearPriority weights[] = {likes, narrow, wrapping};
+        PostBlock block;
+        vector<Post> posts;
+        for (int i = 0; i < SCOREBLOCK - 5; i++) {
+            posts.push_back(randomPost(randGen));
+            block.add(posts.back());
+        }
+        int keys[SCOREBLOCK];
+        for (int kernel = SCALARKERNEL; kernel <= bestScoreKernel(); kernel++) {
+            for (const LinearPriority& linear : weights) {
+                scoreBlock(linear, block, keys, (SCOREKERNEL)kernel);
+                for (int i = 0; i < block.m_count; i++) {
+                    if (keys[i] != linear.score(posts[i])) return false;
+                }
+            }
+        }
+        for (size_t i = 0; i < posts.size(); i++) {
+            if (likes.score(posts[i]) != priorityFn1(posts[i])) return false;
+        }
+        LinearPriority recent;
+        recent.m_postTime = 1;
+        recent.m_connectLevel = 1;
+        recent.m_minKey = 2;
+        recent.m_maxKey = 55;
+        SQueue queue(countingPriorityFn, MAXHEAP, LEFTIST);
+        SQueue reference(priorityFn1, MAXHEAP, LEFTIST);
+        queue.setLinearPriority(likes);
+        for (int i = 0; i < 1000; i++) posts.push_back(randomPost(randGen));
+        priorityCalls = 0;
+        if (queue.insertPosts(posts) != (int)posts.size() || priorityCalls != 0) return false;
+        reference.insertPosts(posts);
+        queue.setPriorityFn(countingPriorityFn, MINHEAP, recent);
+        reference.setPriorityFn(priorityFn2, MINHEAP);
+        queue.finishRebuild();
+        if (priorityCalls != 0 || !checkLeftist(queue) || !checkParents(queue)) return false;
+        while (reference.numPosts() > 0) {
+            if (priorityFn2(queue.getNextPost()) != priorityFn2(reference.getNextPost())) return false;
+        }
+        queue.setPriorityFn(priorityFn1, MAXHEAP);
+        return (!queue.getLinearPriority() && queue.numPosts() == 0);
+    }
+
+    // Test that advancing the window expires a window's posts at once,
+    // that pops, peeks, handles and ordered walks skip them, and that
+    // compaction frees them.
+    bool testWindowedExpiry() {
+        SQueue queue(postIdPriority, MAXHEAP, LEFTIST);
+        queue.setWindow(2);
+        PostHandle old = queue.insertPost(Post(MINPOSTID + 500, 1, 1, 1, 1));
+        for (int i = 1; i < 50; i++) queue.insertPost(Post(MINPOSTID + 500 + i, 1, 1, 1, 1));
+        queue.advanceWindow();
+        for (int i = 0; i < 50; i++) queue.insertPost(Post(MINPOSTID + i, 1, 1, 1, 1));
+        if (queue.numPosts() != 100) return false;
+        queue.advanceWindow();
+        if (queue.numPosts() != 50 || queue.numExpired() != 50) return false;
+        if (queue.removePost(old) || queue.findPost(MINPOSTID + 500)) return false;
+        vector<Post> top = queue.topK(60);
+        if (top.size() != 50 || top[0].getPostID() != MINPOSTID + 49 || top.back().getPostID() != MINPOSTID) return false;
+        if (queue.peek().getPostID() != MINPOSTID + 49) return false;
+        vector<Post> batch;
+        if (queue.getNextPosts(10, batch) != 10 || batch[9].getPostID() != MINPOSTID + 40) return false;
+        if (queue.numPosts() != 40 || queue.numExpired() != 0 || !checkLeftist(queue) || !checkParents(queue)) return false;
+
+        SQueue mixed(postIdPriority, MINHEAP, DARY);
+        mixed.setWindow(3);
+        for (int w = 0; w < 3; w++) {
+            for (int i = 0; i < 30; i++) mixed.insertPost(Post(MINPOSTID + i * 3 + w, 1, 1, 1, 1));
+            mixed.advanceWindow();
+        }
+        if (mixed.numPosts() != 60 || mixed.numExpired() != 30 || mixed.currentWindow() != 3) return false;
+        int last = 0;
+        for (int i = 0; i < 10; i++) {
+            int id = mixed.getNextPost().getPostID();
+            if ((id - MINPOSTID) % 3 == 0 || id < last) return false;
+            last = id;
+        }
+        int expired = mixed.numExpired();
+        int freeBefore = mixed.getPool()->numFree();
+        mixed.compactExpired();
+        if (mixed.numExpired() != 0 || mixed.getPool()->numFree() != freeBefore + expired) return false;
+        while (mixed.numPosts() > 0) {
+            int id = mixed.getNextPost().getPostID();
+            if ((id - MINPOSTID) % 3 == 0 || id < last) return false;
+            last = id;
+        }
+        mixed.insertPost(Post(MINPOSTID, 1, 1, 1, 1));
+        mixed.advanceWindow(3);
+        if (mixed.numPosts() != 0 || mixed.numExpired() != 0) return false;
+
+        SQueue other(postIdPriority, MINHEAP, DARY);
+        try {mixed.setCapacity(10); return false;} catch (const domain_error&) {}
+        try {other.mergeWithQueue(mixed); return false;} catch (const domain_error&) {}
+        try {other.advanceWindow(); return false;} catch (const domain_error&) {}
+        try {queue.setWindow(4); return false;} catch (const domain_error&) {}
+        return true;
+    }
+
+    // Test strict MultiSQueue order, then concurrent producers and
+    // consumers on a relaxed one losing and duplicating nothing.
+    bool testMultiSQueue() {
+        Random randGen(MINPOSTID, MAXPOSTID);
+        MultiSQueue strict(priorityFn2, MINHEAP, LEFTIST, 8, true);
+        for (int i = 0; i < 300; i++) strict.insertPost(randomPost(randGen));
+        vector<int> priorities;
+        while (optional<Post> post = strict.tryGetNextPost()) priorities.push_back(priorityFn2(*post));
+        if (priorities.size() != 300 || !checkRemovalOrder(priorities, true)) return false;
+
+        const int numThreads = 8;
+        const int perThread = 500;
+        MultiSQueue relaxed(priorityFn1, MAXHEAP, SKEW, 16);
+        vector<thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&relaxed, t]() {
+                for (int i = 0; i < perThread; i++) {
+                    relaxed.insertPost(Post(MINPOSTID + t * perThread + i, i % MAXLIKES, 1, 1, 1));
+                }
+            });
+        }
+        for (thread& worker : threads) worker.join();
+        if (relaxed.numPosts() != numThreads * perThread) return false;
+        threads.clear();
+        vector<vector<int>> popped(numThreads);
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&relaxed, &popped, t]() {
+                Post post;
+                while (relaxed.tryGetNextPost(post)) popped[t].push_back(post.getPostID());
+            });
+        }
+        for (thread& worker : threads) worker.join();
+        vector<int> ids;
+        for (const vector<int>& list : popped) ids.insert(ids.end(), list.begin(), list.end());
+        sort(ids.begin(), ids.end());
+        if (ids.size() != (size_t)(numThreads * perThread) || relaxed.numPosts() != 0) return false;
+        return (adjacent_find(ids.begin(), ids.end()) == ids.end());
+    }
 };
     
 // ---------------------- Main Function ----------------------
 int main() {
     Tester tester;
     int passed = 0;
-    const int total = 14;
+    const int total = 44;
         
     cout << "Running testsx..." << endl;
         
@@ -434,6 +1550,77 @@ int main() {
     if (tester.testMergeDifferentPriorityFunctions()) { cout << "testMergeDifferentPriorityFunctions PASSED" << endl; ++passed; }
     else cout << "testMergeDifferentPriorityFunctions FAILED" << endl;
         
+    if (tester.testPoolReusesNodes()) { cout << "testPoolReusesNodes PASSED" << endl; ++passed; }
+    else cout << "testPoolReusesNodes FAILED" << endl;
+        
+    if (tester.testMergePools()) { cout << "testMergePools PASSED" << endl; ++passed; }
+    else cout << "testMergePools FAILED" << endl;
+        
+    if (tester.testLeftistInvariants()) { cout << "testLeftistInvariants PASSED" << endl; ++passed; }
+    else cout << "testLeftistInvariants FAILED" << endl;
+        
+    if (tester.testDeepHeap()) { cout << "testDeepHeap PASSED" << endl; ++passed; }
+    else cout << "testDeepHeap FAILED" << endl;
+        
+    if (tester.testInsertPosts()) { cout << "testInsertPosts PASSED" << endl; ++passed; }
+    else cout << "testInsertPosts FAILED" << endl;
+        
+    if (tester.testCachedPriorities()) { cout << "testCachedPriorities PASSED" << endl; ++passed; }
+    else cout << "testCachedPriorities FAILED" << endl;
+        
+    if (tester.testBasicSQueue()) { cout << "testBasicSQueue PASSED" << endl; ++passed; }
+    else cout << "testBasicSQueue FAILED" << endl;
+        
+    if (tester.testMoveSemantics()) { cout << "testMoveSemantics PASSED" << endl; ++passed; }
+    else cout << "testMoveSemantics FAILED" << endl;
+        
+    if (tester.testTryGetNextPost()) { cout << "testTryGetNextPost PASSED" << endl; ++passed; }
+    else cout << "testTryGetNextPost FAILED" << endl;
+        
+    if (tester.testEmplacePost()) { cout << "testEmplacePost PASSED" << endl; ++passed; }
+    else cout << "testEmplacePost FAILED" << endl;
+        
+    if (tester.testCompactNodes()) { cout << "testCompactNodes PASSED" << endl; ++passed; }
+    else cout << "testCompactNodes FAILED" << endl;
+    if (tester.testBucketStructure()) { cout << "testBucketStructure PASSED" << endl; ++passed; }
+    else cout << "testBucketStructure FAILED" << endl;
+    if (tester.testBucketFallback()) { cout << "testBucketFallback PASSED" << endl; ++passed; }
+    else cout << "testBucketFallback FAILED" << endl;
+    if (tester.testPairingAndDary()) { cout << "testPairingAndDary PASSED" << endl; ++passed; }
+    else cout << "testPairingAndDary FAILED" << endl;
+    if (tester.testMultiSQueue()) { cout << "testMultiSQueue PASSED" << endl; ++passed; }
+    else cout << "testMultiSQueue FAILED" << endl;
+    if (tester.testLazyRebuild()) { cout << "testLazyRebuild PASSED" << endl; ++passed; }
+    else cout << "testLazyRebuild FAILED" << endl;
+    if (tester.testRemoveAndUpdate()) { cout << "testRemoveAndUpdate PASSED" << endl; ++passed; }
+    else cout << "testRemoveAndUpdate FAILED" << endl;
+    if (tester.testBoundedQueue()) { cout << "testBoundedQueue PASSED" << endl; ++passed; }
+    else cout << "testBoundedQueue FAILED" << endl;
+    if (tester.testBoundedEvictDuringRebuild()) { cout << "testBoundedEvictDuringRebuild PASSED" << endl; ++passed; }
+    else cout << "testBoundedEvictDuringRebuild FAILED" << endl;
+    if (tester.testPeekAndOrderedIterator()) { cout << "testPeekAndOrderedIterator PASSED" << endl; ++passed; }
+    else cout << "testPeekAndOrderedIterator FAILED" << endl;
+    if (tester.testGetNextPosts()) { cout << "testGetNextPosts PASSED" << endl; ++passed; }
+    else cout << "testGetNextPosts FAILED" << endl;
+    if (tester.testStats()) { cout << "testStats PASSED" << endl; ++passed; }
+    else cout << "testStats FAILED" << endl;
+    if (tester.testSnapshot()) { cout << "testSnapshot PASSED" << endl; ++passed; }
+    else cout << "testSnapshot FAILED" << endl;
+    if (tester.testPostLoader()) { cout << "testPostLoader PASSED" << endl; ++passed; }
+    else cout << "testPostLoader FAILED" << endl;
+    if (tester.testMergeAll()) { cout << "testMergeAll PASSED" << endl; ++passed; }
+    else cout << "testMergeAll FAILED" << endl;
+    if (tester.testParallelRebuild()) { cout << "testParallelRebuild PASSED" << endl; ++passed; }
+    else cout << "testParallelRebuild FAILED" << endl;
+    if (tester.testPersistentSQueue()) { cout << "testPersistentSQueue PASSED" << endl; ++passed; }
+    else cout << "testPersistentSQueue FAILED" << endl;
+    if (tester.testMultiViewSQueue()) { cout << "testMultiViewSQueue PASSED" << endl; ++passed; }
+    else cout << "testMultiViewSQueue FAILED" << endl;
+    if (tester.testBatchScoring()) { cout << "testBatchScoring PASSED" << endl; ++passed; }
+    else cout << "testBatchScoring FAILED" << endl;
+    if (tester.testWindowedExpiry()) { cout << "testWindowedExpiry PASSED" << endl; ++passed; }
+    else cout << "testWindowedExpiry FAILED" << endl;
+        
     cout << "\nTests Passed: " << passed << " out of " << total << endl;
     return 0;
 }
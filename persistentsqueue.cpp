@@ -0,0 +1,252 @@
+/*Title: persistentsqueue.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: This file implements the functions in persistentsqueue.h
+*/
+#include "persistentsqueue.h"
+
+PersistentSQueue::PersistentSQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure) {
+  if (structure != SKEW && structure != LEFTIST)
+    throw domain_error("A persistent queue needs the SKEW or LEFTIST structure.");
+  m_priorFunc = priFn;
+  m_heapType = heapType;
+  m_structure = structure;
+  m_root = nullptr;
+  m_size = 0;
+}
+
+PersistentSQueue::~PersistentSQueue() {
+  release(m_root);
+}
+
+// O(1): the copy shares the tree
+PersistentSQueue::PersistentSQueue(const PersistentSQueue& rhs) {
+  m_priorFunc = rhs.m_priorFunc;
+  m_heapType = rhs.m_heapType;
+  m_structure = rhs.m_structure;
+  m_root = retain(rhs.m_root);
+  m_size = rhs.m_size;
+}
+
+PersistentSQueue& PersistentSQueue::operator=(const PersistentSQueue& rhs) {
+  if (this != &rhs) {
+    Node* root = retain(rhs.m_root);
+    release(m_root);
+    m_priorFunc = rhs.m_priorFunc;
+    m_heapType = rhs.m_heapType;
+    m_structure = rhs.m_structure;
+    m_root = root;
+    m_size = rhs.m_size;
+  }
+  return *this;
+}
+
+PersistentSQueue::PersistentSQueue(PersistentSQueue&& rhs) noexcept {
+  m_priorFunc = rhs.m_priorFunc;
+  m_heapType = rhs.m_heapType;
+  m_structure = rhs.m_structure;
+  m_root = rhs.m_root;
+  m_size = rhs.m_size;
+  rhs.m_root = nullptr;
+  rhs.m_size = 0;
+}
+
+PersistentSQueue& PersistentSQueue::operator=(PersistentSQueue&& rhs) noexcept {
+  if (this != &rhs) {
+    release(m_root);
+    m_priorFunc = rhs.m_priorFunc;
+    m_heapType = rhs.m_heapType;
+    m_structure = rhs.m_structure;
+    m_root = rhs.m_root;
+    m_size = rhs.m_size;
+    rhs.m_root = nullptr;
+    rhs.m_size = 0;
+  }
+  return *this;
+}
+
+bool PersistentSQueue::insertPost(const Post& post) {
+  int key = m_priorFunc(post);
+  if (key == 0) return false;
+  Node* single = new Node(post, key);
+  Node* root;
+  try {
+    root = merge(m_root, single);
+  } catch (...) {
+    release(single);
+    throw;
+  }
+  release(single);
+  release(m_root);
+  m_root = root;
+  m_size++;
+  return true;
+}
+
+Post PersistentSQueue::getNextPost() {
+  Post post;
+  if (!tryGetNextPost(post)) {
+    throw out_of_range("Queue is empty");
+  }
+  return post;
+}
+
+// Only the right spines of the two subtrees are copied, copies sharing
+// the old root still see it
+bool PersistentSQueue::tryGetNextPost(Post& post) {
+  if (m_root == nullptr) return false;
+  Node* rest = merge(m_root->m_left, m_root->m_right);
+  post = m_root->m_post;
+  release(m_root);
+  m_root = rest;
+  m_size--;
+  return true;
+}
+
+optional<Post> PersistentSQueue::tryGetNextPost() {
+  Post post;
+  if (!tryGetNextPost(post)) return nullopt;
+  return post;
+}
+
+Post PersistentSQueue::peek() const {
+  if (m_root == nullptr) {
+    throw out_of_range("Queue is empty");
+  }
+  return m_root->m_post;
+}
+
+optional<Post> PersistentSQueue::tryPeek() const {
+  if (m_root == nullptr) return nullopt;
+  return m_root->m_post;
+}
+
+// rhs may be this queue, the posts are then queued twice
+void PersistentSQueue::mergeWithQueue(const PersistentSQueue& rhs) {
+  if (m_priorFunc != rhs.m_priorFunc ||
+      m_heapType != rhs.m_heapType ||
+      m_structure != rhs.m_structure)
+    throw domain_error("Incompatible queues cannot be merged.");
+  Node* root = merge(m_root, rhs.m_root);
+  release(m_root);
+  m_root = root;
+  m_size += rhs.m_size;
+}
+
+void PersistentSQueue::clear() {
+  release(m_root);
+  m_root = nullptr;
+  m_size = 0;
+}
+
+int PersistentSQueue::numPosts() const {
+  return m_size;
+}
+
+prifn_t PersistentSQueue::getPriorityFn() const {
+  return m_priorFunc;
+}
+
+HEAPTYPE PersistentSQueue::getHeapType() const {
+  return m_heapType;
+}
+
+STRUCTURE PersistentSQueue::getStructure() const {
+  return m_structure;
+}
+
+// Like SQueue, posts keep their place in the queue even if the new
+// function rejects them. New single nodes are melded pairwise in rounds.
+void PersistentSQueue::setPriorityFn(prifn_t priFn, HEAPTYPE heapType) {
+  vector<Node*> heaps;
+  vector<const Node*> stack;
+  if (m_root != nullptr) stack.push_back(m_root);
+  try {
+    while (!stack.empty()) {
+      const Node* node = stack.back();
+      stack.pop_back();
+      heaps.push_back(new Node(node->m_post, priFn(node->m_post)));
+      if (node->m_left != nullptr) stack.push_back(node->m_left);
+      if (node->m_right != nullptr) stack.push_back(node->m_right);
+    }
+  } catch (...) {
+    for (Node* heap : heaps) release(heap);
+    throw;
+  }
+  m_priorFunc = priFn;
+  m_heapType = heapType;
+  size_t count = heaps.size();
+  while (count > 1) {
+    size_t out = 0;
+    for (size_t i = 0; i + 1 < count; i += 2) {
+      Node* heap = merge(heaps[i], heaps[i + 1]);
+      release(heaps[i]);
+      release(heaps[i + 1]);
+      heaps[out++] = heap;
+    }
+    if (count % 2 == 1) heaps[out++] = heaps[count - 1];
+    count = out;
+  }
+  release(m_root);
+  m_root = (count == 1 ? heaps[0] : nullptr);
+}
+
+PersistentSQueue::Node* PersistentSQueue::retain(Node* node) {
+  if (node != nullptr) node->m_refs.fetch_add(1, memory_order_relaxed);
+  return node;
+}
+
+void PersistentSQueue::release(Node* node) {
+  vector<Node*> stack;
+  while (node != nullptr) {
+    // acq_rel: the thread freeing a node sees every use of it by others
+    if (node->m_refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+      if (node->m_left != nullptr) stack.push_back(node->m_left);
+      if (node->m_right != nullptr) stack.push_back(node->m_right);
+      delete node;
+    }
+    if (stack.empty()) break;
+    node = stack.back();
+    stack.pop_back();
+  }
+}
+
+bool PersistentSQueue::before(const Node& h1, const Node& h2) const {
+  if (m_heapType == MINHEAP) return (h1.m_key <= h2.m_key); // smaller value = higher priority
+  else return (h1.m_key >= h2.m_key); // larger value = higher priority
+}
+
+// Top-down along the right spines like the HeapEngine kernels, but every
+// node taken from the path is a fresh copy that keeps the old left
+// subtree. The copies are then linked bottom-up, with the skew swap or
+// the leftist NPL repair, before anything can see them.
+PersistentSQueue::Node* PersistentSQueue::merge(Node* h1, Node* h2) const {
+  vector<Node*> path;
+  try {
+    while (h1 != nullptr && h2 != nullptr) {
+      if (!before(*h1, *h2)) swap(h1, h2);
+      Node* copy = new Node(h1->m_post, h1->m_key);
+      copy->m_left = retain(h1->m_left);
+      path.push_back(copy);
+      h1 = h1->m_right;
+    }
+  } catch (...) {
+    for (Node* copy : path) release(copy);
+    throw;
+  }
+  Node* rest = retain(h1 != nullptr ? h1 : h2);
+  for (size_t i = path.size(); i-- > 0;) {
+    Node* node = path[i];
+    node->m_right = rest;
+    if (m_structure == SKEW) {
+      swap(node->m_left, node->m_right);
+    } else {
+      int nplLeft = (node->m_left != nullptr ? node->m_left->m_npl : 0);
+      int nplRight = (node->m_right != nullptr ? node->m_right->m_npl : 0);
+      if (nplLeft < nplRight) swap(node->m_left, node->m_right);
+      node->m_npl = (node->m_right != nullptr ? node->m_right->m_npl + 1 : 0);
+    }
+    rest = node;
+  }
+  return rest;
+}
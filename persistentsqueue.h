@@ -0,0 +1,85 @@
+/*Title: persistentsqueue.h
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Persistent (copy-on-write) skew or leftist heap of posts.
+  Nodes are immutable once linked and reference counted, so any number of
+  queues can share them. A copy of a queue shares the whole tree and costs
+  O(1). A merge copies only the nodes on the right spines it walks, and
+  everything below them stays shared. For LEFTIST the spines are
+  O(log n) long, so insert and pop allocate O(log n) new nodes whatever
+  the other copies do. SKEW shares the code, but its bounds are only
+  amortized and a copy can repeat an expensive merge, so LEFTIST is the
+  structure to use for snapshots.
+
+  One queue object is not thread-safe, but copies sharing nodes may be
+  used from different threads, e.g. a writer inserting while readers
+  pop their own snapshots.
+*/
+#ifndef PERSISTENTSQUEUE_H
+#define PERSISTENTSQUEUE_H
+#include "squeue.h"
+#include <atomic>
+
+class PersistentSQueue{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+
+    // Throws domain_error for a structure other than SKEW or LEFTIST
+    PersistentSQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure);
+    ~PersistentSQueue();
+    // Copies share every node, see the description above
+    PersistentSQueue(const PersistentSQueue& rhs);
+    PersistentSQueue& operator=(const PersistentSQueue& rhs);
+    PersistentSQueue(PersistentSQueue&& rhs) noexcept;
+    PersistentSQueue& operator=(PersistentSQueue&& rhs) noexcept;
+
+    // Returns false for posts the priority function rejects
+    bool insertPost(const Post& post);
+    Post getNextPost(); // Throws out_of_range if empty
+    bool tryGetNextPost(Post& post);
+    optional<Post> tryGetNextPost();
+    Post peek() const; // Throws out_of_range if empty
+    optional<Post> tryPeek() const;
+    // Adds the posts of rhs, which keeps them; throws domain_error if the
+    // queues differ in priority function, heap type or structure
+    void mergeWithQueue(const PersistentSQueue& rhs);
+    void clear();
+    int numPosts() const;
+    prifn_t getPriorityFn() const;
+    HEAPTYPE getHeapType() const;
+    STRUCTURE getStructure() const;
+    // Rekeys every post and builds a new tree in O(n), other copies keep
+    // the old one
+    void setPriorityFn(prifn_t priFn, HEAPTYPE heapType);
+
+    private:
+    // Never changed once it is linked into a tree. Every link and every
+    // queue root holds one reference.
+    struct Node{
+        Post m_post;
+        int m_key;
+        int m_npl;           // null path length, 0 without a right child
+        atomic<int> m_refs;
+        Node* m_left;
+        Node* m_right;
+        Node(const Post& post, int key)
+            : m_post(post), m_key(key), m_npl(0), m_refs(1), m_left(nullptr), m_right(nullptr) {}
+    };
+
+    prifn_t m_priorFunc;
+    HEAPTYPE m_heapType;
+    STRUCTURE m_structure;
+    Node* m_root;
+    int m_size;
+
+    static Node* retain(Node* node); // adds a reference, returns node
+    // Drops a reference and frees what only it kept alive, without
+    // recursion since a skew tree can be a long chain
+    static void release(Node* node);
+    bool before(const Node& h1, const Node& h2) const; // h1 may stay above h2
+    // Melds two borrowed heaps into a new reference, copying the nodes on
+    // the merge path and sharing the rest
+    Node* merge(Node* h1, Node* h2) const;
+};
+#endif
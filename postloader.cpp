@@ -0,0 +1,221 @@
+/*Title: postloader.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: This file implements the functions in postloader.h
+*/
+#include "postloader.h"
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+const int POSTFIELDS = 5;//fields of one post in either format
+const size_t BINARYRECORD = POSTFIELDS * sizeof(int32_t);//bytes of one binary post
+
+// Thrown inside the parser thread when the caller stopped taking batches
+struct LoadStopped{};
+
+// A bounded hand-off of batches. Emptied batches come back as spares so
+// their memory is reused instead of reallocated for every batch.
+struct PostLoader::Channel{
+    mutex m_lock;
+    condition_variable m_changed;
+    deque<vector<Post>> m_full;   // parsed batches in input order
+    vector<vector<Post>> m_spare; // emptied batches for reuse
+    bool m_done = false;          // the parser sent its last batch
+    bool m_stopped = false;       // the caller stopped receiving
+    exception_ptr m_error;        // why the parser ended early, if it did
+
+    // Parser side: hands batch over and replaces it with an empty one
+    void send(vector<Post>& batch) {
+        unique_lock<mutex> lock(m_lock);
+        m_changed.wait(lock, [this]() {return (m_full.size() < MAXLOADBATCHES || m_stopped);});
+        if (m_stopped) throw LoadStopped();
+        m_full.push_back(std::move(batch));
+        batch = vector<Post>();
+        if (!m_spare.empty()) {
+            batch.swap(m_spare.back());
+            m_spare.pop_back();
+        }
+        m_changed.notify_all();
+    }
+    void finish(exception_ptr error) {
+        lock_guard<mutex> lock(m_lock);
+        m_done = true;
+        m_error = error;
+        m_changed.notify_all();
+    }
+    // Caller side: returns the previous batch, false once everything is received
+    bool receive(vector<Post>& batch) {
+        unique_lock<mutex> lock(m_lock);
+        if (batch.capacity() > 0) {
+            batch.clear();
+            m_spare.push_back(std::move(batch));
+            batch = vector<Post>();
+        }
+        m_changed.wait(lock, [this]() {return (!m_full.empty() || m_done);});
+        if (m_full.empty()) return false;
+        batch = std::move(m_full.front());
+        m_full.pop_front();
+        m_changed.notify_all();
+        return true;
+    }
+    void stop() {
+        lock_guard<mutex> lock(m_lock);
+        m_stopped = true;
+        m_changed.notify_all();
+    }
+};
+
+PostLoader::PostLoader(POSTFORMAT format, int batchSize, int chunkSize) {
+  m_format = format;
+  m_batchSize = max(1, batchSize);
+  // A chunk holds at least one binary record
+  m_chunkSize = max((int)BINARYRECORD, chunkSize);
+}
+
+LoadStats PostLoader::loadFile(const string& path, SQueue& queue) {
+  if (path == "-") return load(cin, queue);
+  ifstream in(path, ios::binary);
+  if (!in) throw domain_error("Cannot open post file " + path);
+  return load(in, queue);
+}
+
+// The parser thread fills batches while this thread inserts them
+LoadStats PostLoader::load(istream& in, SQueue& queue) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  Channel channel;
+  LoadStats stats;
+  LoadStats parsed;
+  thread parser([this, &in, &channel, &parsed]() {
+    try {
+      parse(in, channel, parsed);
+      channel.finish(nullptr);
+    } catch (const LoadStopped&) {
+      channel.finish(nullptr);
+    } catch (...) {
+      channel.finish(current_exception());
+    }
+  });
+  vector<Post> batch;
+  try {
+    while (channel.receive(batch)) stats.m_inserted += queue.insertPosts(batch);
+  } catch (...) {
+    channel.stop();
+    parser.join();
+    throw;
+  }
+  parser.join();
+  if (channel.m_error) rethrow_exception(channel.m_error);
+  stats.m_parsed = parsed.m_parsed;
+  stats.m_invalid = parsed.m_invalid;
+  stats.m_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return stats;
+}
+
+// Reads chunk after chunk into one buffer. The unfinished tail of a chunk
+// (part of a line or a record) moves to the front of the buffer and the
+// next read appends to it; a line longer than the buffer grows it.
+void PostLoader::parse(istream& in, Channel& channel, LoadStats& stats) const {
+  vector<char> buffer(m_chunkSize);
+  vector<Post> batch;
+  batch.reserve(m_batchSize);
+  size_t carry = 0;
+  bool header = true;
+  while (true) {
+    if (carry == buffer.size()) buffer.resize(buffer.size() * 2);
+    in.read(buffer.data() + carry, buffer.size() - carry);
+    if (in.bad()) throw domain_error("Cannot read posts.");
+    size_t end = carry + (size_t)in.gcount();
+    bool eof = !in;
+    size_t done = end;
+    if (m_format == BINARYPOSTS) {
+      done = end / BINARYRECORD * BINARYRECORD;
+      for (size_t pos = 0; pos < done; pos += BINARYRECORD) {
+        int32_t record[POSTFIELDS];
+        memcpy(record, buffer.data() + pos, BINARYRECORD);
+        int fields[POSTFIELDS] = {record[0], record[1], record[2], record[3], record[4]};
+        addPost(fields, batch, channel, stats);
+      }
+      if (eof && done != end) throw domain_error("Binary posts end inside a record.");
+    } else {
+      if (!eof) {
+        while (done > 0 && buffer[done - 1] != '\n') done--;
+      }
+      parseCsv(buffer.data(), buffer.data() + done, header, batch, channel, stats);
+    }
+    carry = end - done;
+    memmove(buffer.data(), buffer.data() + done, carry);
+    if (eof) break;
+  }
+  if (!batch.empty()) channel.send(batch);
+}
+
+void PostLoader::parseCsv(const char* first, const char* last, bool& header, vector<Post>& batch,
+                          Channel& channel, LoadStats& stats) const {
+  while (first < last) {
+    const char* newline = (const char*)memchr(first, '\n', last - first);
+    const char* end = (newline != nullptr ? newline : last);
+    const char* text = first;
+    while (text < end && (*text == ' ' || *text == '\t' || *text == '\r')) text++;
+    if (text < end) {
+      int fields[POSTFIELDS];
+      bool number = (*text == '-' || *text == '+' || (*text >= '0' && *text <= '9'));
+      if (parseCsvLine(first, end, fields)) addPost(fields, batch, channel, stats);
+      else if (number || !header) stats.m_invalid++;
+      header = false;
+    }
+    first = (newline != nullptr ? newline + 1 : last);
+  }
+}
+
+// Five integers separated by commas, nothing else but blanks
+bool PostLoader::parseCsvLine(const char* first, const char* last, int fields[5]) {
+  const char* pos = first;
+  for (int field = 0; field < POSTFIELDS; field++) {
+    while (pos < last && (*pos == ' ' || *pos == '\t')) pos++;
+    bool negative = (pos < last && *pos == '-');
+    if (pos < last && (*pos == '-' || *pos == '+')) pos++;
+    if (pos == last || *pos < '0' || *pos > '9') return false;
+    long long value = 0;
+    while (pos < last && *pos >= '0' && *pos <= '9') {
+      value = value * 10 + (*pos - '0');
+      if (value > INT_MAX) return false;
+      pos++;
+    }
+    fields[field] = (int)(negative ? -value : value);
+    while (pos < last && (*pos == ' ' || *pos == '\t')) pos++;
+    if (field + 1 < POSTFIELDS) {
+      if (pos == last || *pos != ',') return false;
+      pos++;
+    }
+  }
+  while (pos < last && (*pos == ' ' || *pos == '\t' || *pos == '\r')) pos++;
+  return (pos == last);
+}
+
+bool PostLoader::validPost(const int fields[5]) {
+  return (fields[0] >= MINPOSTID && fields[0] <= MAXPOSTID &&
+          fields[1] >= MINLIKES && fields[1] <= MAXLIKES &&
+          fields[2] >= MINCONLEVEL && fields[2] <= MAXCONLEVEL &&
+          fields[3] >= MINTIME && fields[3] <= MAXTIME &&
+          fields[4] >= MININTERESTLEVEL && fields[4] <= MAXINTERESTLEVEL);
+}
+
+void PostLoader::addPost(const int fields[5], vector<Post>& batch, Channel& channel, LoadStats& stats) const {
+  if (!validPost(fields)) {
+    stats.m_invalid++;
+    return;
+  }
+  batch.push_back(Post(fields[0], fields[1], fields[2], fields[3], fields[4]));
+  stats.m_parsed++;
+  if ((int)batch.size() >= m_batchSize) {
+    channel.send(batch);
+    batch.reserve(m_batchSize);
+  }
+}
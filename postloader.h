@@ -0,0 +1,65 @@
+/*Title: postloader.h
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Streaming loader that fills an SQueue from a CSV or binary
+  dump of posts. The input is read in large chunks and parsed in place,
+  without building a string per line. Every field is checked against the
+  MIN.../MAX... limits in squeue.h, and a post outside them is counted and
+  skipped rather than clamped the way the Post constructor clamps it.
+
+  A parser thread turns chunks into batches of posts while the calling
+  thread hands finished batches to SQueue::insertPosts (bulk build and
+  merge), so parsing and heap building overlap. The queue is only ever
+  used from the calling thread.
+
+  CSV: one post per line, "ID,likes,connectLevel,postTime,interestLevel".
+  Spaces and a trailing '\r' are allowed, blank lines are skipped and a
+  first line that does not start with a number is taken as a header.
+  Binary: five 32-bit integers per post in host byte order, same order.
+*/
+#ifndef POSTLOADER_H
+#define POSTLOADER_H
+#include "squeue.h"
+
+const int DEFAULTLOADBATCH = 65536;//posts handed to insertPosts at once
+const int DEFAULTLOADCHUNK = 1 << 20;//bytes read from the input at once
+const int MAXLOADBATCHES = 4;//parsed batches waiting for the queue
+enum POSTFORMAT {CSVPOSTS, BINARYPOSTS};
+
+struct LoadStats{
+    long long m_parsed = 0;   // posts that passed the field checks
+    long long m_invalid = 0;  // lines or records that did not
+    long long m_inserted = 0; // posts the queue accepted (priority not 0)
+    double m_seconds = 0;     // wall time of the whole load
+    double postsPerSecond() const {return (m_seconds > 0 ? m_parsed / m_seconds : 0.0);}
+};
+
+class PostLoader{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+    explicit PostLoader(POSTFORMAT format = CSVPOSTS, int batchSize = DEFAULTLOADBATCH,
+                        int chunkSize = DEFAULTLOADCHUNK);
+    // Read in until the end and insert every valid post into queue.
+    // Throws domain_error on a read error or a binary stream that ends
+    // inside a record; the posts inserted before that stay in the queue.
+    LoadStats load(istream& in, SQueue& queue);
+    LoadStats loadFile(const string& path, SQueue& queue); // "-" reads stdin
+
+    private:
+    struct Channel; // batches passed from the parser thread to the caller
+
+    POSTFORMAT m_format;
+    int m_batchSize;
+    int m_chunkSize;
+
+    void parse(istream& in, Channel& channel, LoadStats& stats) const;
+    // Parses the lines of [first, last), the last one may lack its '\n'
+    void parseCsv(const char* first, const char* last, bool& header, vector<Post>& batch,
+                  Channel& channel, LoadStats& stats) const;
+    static bool parseCsvLine(const char* first, const char* last, int fields[5]);
+    // Checks the fields and queues the post, sending full batches on
+    void addPost(const int fields[5], vector<Post>& batch, Channel& channel, LoadStats& stats) const;
+    static bool validPost(const int fields[5]);
+};
+#endif
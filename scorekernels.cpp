@@ -0,0 +1,123 @@
+/*Title: scorekernels.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Batch scoring of posts with a LinearPriority (see squeue.h).
+  A block holds one array per post field, so the weighted sum runs 8 posts
+  per instruction with AVX2 or 4 with SSE4.1, followed by the range check
+  that turns invalid keys into 0. The kernels are compiled with target
+  attributes and picked at run time, so the library needs no -mavx2 and
+  still runs on older CPUs. Other architectures use the scalar loop.
+*/
+#include "squeue.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SQUEUE_X86_KERNELS
+#endif
+
+// Unsigned arithmetic wraps like the SIMD lanes instead of overflowing
+int LinearPriority::score(const Post& post) const {
+  uint32_t sum = (uint32_t)m_bias +
+                 (uint32_t)m_postID * (uint32_t)post.getPostID() +
+                 (uint32_t)m_likes * (uint32_t)post.getNumLikes() +
+                 (uint32_t)m_connectLevel * (uint32_t)post.getConnectLevel() +
+                 (uint32_t)m_postTime * (uint32_t)post.getPostTime() +
+                 (uint32_t)m_interestLevel * (uint32_t)post.getInterestLevel();
+  int key = (int)sum;
+  return (key < m_minKey || key > m_maxKey ? 0 : key);
+}
+
+// Posts first..m_count of block, also the tail of the SIMD kernels
+static void scoreScalar(const LinearPriority& linear, const PostBlock& block, int* keys, int first) {
+  for (int i = first; i < block.m_count; i++) {
+    uint32_t sum = (uint32_t)linear.m_bias +
+                   (uint32_t)linear.m_postID * (uint32_t)block.m_postID[i] +
+                   (uint32_t)linear.m_likes * (uint32_t)block.m_likes[i] +
+                   (uint32_t)linear.m_connectLevel * (uint32_t)block.m_connectLevel[i] +
+                   (uint32_t)linear.m_postTime * (uint32_t)block.m_postTime[i] +
+                   (uint32_t)linear.m_interestLevel * (uint32_t)block.m_interestLevel[i];
+    int key = (int)sum;
+    keys[i] = (key < linear.m_minKey || key > linear.m_maxKey ? 0 : key);
+  }
+}
+
+#ifdef SQUEUE_X86_KERNELS
+// The field arrays are 32-byte aligned and i steps by the lane count, so
+// the loads are aligned; keys may not be.
+__attribute__((target("sse4.1")))
+static void scoreSse(const LinearPriority& linear, const PostBlock& block, int* keys) {
+  const __m128i postID = _mm_set1_epi32(linear.m_postID);
+  const __m128i likes = _mm_set1_epi32(linear.m_likes);
+  const __m128i connectLevel = _mm_set1_epi32(linear.m_connectLevel);
+  const __m128i postTime = _mm_set1_epi32(linear.m_postTime);
+  const __m128i interestLevel = _mm_set1_epi32(linear.m_interestLevel);
+  const __m128i bias = _mm_set1_epi32(linear.m_bias);
+  const __m128i minKey = _mm_set1_epi32(linear.m_minKey);
+  const __m128i maxKey = _mm_set1_epi32(linear.m_maxKey);
+  int i = 0;
+  for (; i + 4 <= block.m_count; i += 4) {
+    __m128i sum = bias;
+    sum = _mm_add_epi32(sum, _mm_mullo_epi32(postID, _mm_load_si128((const __m128i*)(block.m_postID + i))));
+    sum = _mm_add_epi32(sum, _mm_mullo_epi32(likes, _mm_load_si128((const __m128i*)(block.m_likes + i))));
+    sum = _mm_add_epi32(sum, _mm_mullo_epi32(connectLevel, _mm_load_si128((const __m128i*)(block.m_connectLevel + i))));
+    sum = _mm_add_epi32(sum, _mm_mullo_epi32(postTime, _mm_load_si128((const __m128i*)(block.m_postTime + i))));
+    sum = _mm_add_epi32(sum, _mm_mullo_epi32(interestLevel, _mm_load_si128((const __m128i*)(block.m_interestLevel + i))));
+    __m128i invalid = _mm_or_si128(_mm_cmplt_epi32(sum, minKey), _mm_cmpgt_epi32(sum, maxKey));
+    _mm_storeu_si128((__m128i*)(keys + i), _mm_andnot_si128(invalid, sum));
+  }
+  scoreScalar(linear, block, keys, i);
+}
+
+__attribute__((target("avx2")))
+static void scoreAvx2(const LinearPriority& linear, const PostBlock& block, int* keys) {
+  const __m256i postID = _mm256_set1_epi32(linear.m_postID);
+  const __m256i likes = _mm256_set1_epi32(linear.m_likes);
+  const __m256i connectLevel = _mm256_set1_epi32(linear.m_connectLevel);
+  const __m256i postTime = _mm256_set1_epi32(linear.m_postTime);
+  const __m256i interestLevel = _mm256_set1_epi32(linear.m_interestLevel);
+  const __m256i bias = _mm256_set1_epi32(linear.m_bias);
+  const __m256i minKey = _mm256_set1_epi32(linear.m_minKey);
+  const __m256i maxKey = _mm256_set1_epi32(linear.m_maxKey);
+  int i = 0;
+  for (; i + 8 <= block.m_count; i += 8) {
+    __m256i sum = bias;
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(postID, _mm256_load_si256((const __m256i*)(block.m_postID + i))));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(likes, _mm256_load_si256((const __m256i*)(block.m_likes + i))));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(connectLevel, _mm256_load_si256((const __m256i*)(block.m_connectLevel + i))));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(postTime, _mm256_load_si256((const __m256i*)(block.m_postTime + i))));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(interestLevel, _mm256_load_si256((const __m256i*)(block.m_interestLevel + i))));
+    // AVX2 has no signed less-than, min > sum is the same test
+    __m256i invalid = _mm256_or_si256(_mm256_cmpgt_epi32(minKey, sum), _mm256_cmpgt_epi32(sum, maxKey));
+    _mm256_storeu_si256((__m256i*)(keys + i), _mm256_andnot_si256(invalid, sum));
+  }
+  scoreScalar(linear, block, keys, i);
+}
+#endif
+
+SCOREKERNEL bestScoreKernel() {
+#ifdef SQUEUE_X86_KERNELS
+  static const SCOREKERNEL best = (__builtin_cpu_supports("avx2") ? AVX2KERNEL :
+                                   __builtin_cpu_supports("sse4.1") ? SSEKERNEL : SCALARKERNEL);
+  return best;
+#else
+  return SCALARKERNEL;
+#endif
+}
+
+void scoreBlock(const LinearPriority& linear, const PostBlock& block, int* keys) {
+  scoreBlock(linear, block, keys, bestScoreKernel());
+}
+
+void scoreBlock(const LinearPriority& linear, const PostBlock& block, int* keys, SCOREKERNEL kernel) {
+  if (kernel > bestScoreKernel()) throw domain_error("This CPU cannot run the requested score kernel.");
+#ifdef SQUEUE_X86_KERNELS
+  if (kernel == AVX2KERNEL) {
+    scoreAvx2(linear, block, keys);
+    return;
+  }
+  if (kernel == SSEKERNEL) {
+    scoreSse(linear, block, keys);
+    return;
+  }
+#endif
+  scoreScalar(linear, block, keys, 0);
+}
@@ -4,14 +4,751 @@
   Description: This file implements the functions in squeue.h
 */
 #include "squeue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#ifdef SQUEUE_STATS
+thread_local SQueueStats* activeStats = nullptr;
+
+static int64_t steadyNs() {
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StatsScope::StatsScope(SQueueStats& stats, LatencyHistogram* latency) {
+  m_saved = activeStats;
+  m_latency = latency;
+  m_startNs = (latency != nullptr ? steadyNs() : 0);
+  activeStats = &stats;
+}
+
+StatsScope::~StatsScope() {
+  if (m_latency != nullptr) m_latency->record((uint64_t)(steadyNs() - m_startNs));
+  activeStats = m_saved;
+}
+#endif
+
+// --- LatencyHistogram ---
+void LatencyHistogram::record(uint64_t ns) {
+  int bin = 63 - __builtin_clzll(ns | 1);
+  m_bins[min(bin, LATENCYBINS - 1)]++;
+  m_count++;
+  m_totalNs += ns;
+  if (ns > m_maxNs) m_maxNs = ns;
+}
+
+// --- PostPool ---
+// Slab registry shared by all pools. The table entries and owners of a
+// slab are only touched by the pool holding it; the free slab list is
+// guarded by slabLock and linked through m_nextFree, so returning slabs
+// never allocates.
+struct SlabInfo{
+    PostPool* m_owner;   // pool holding the slab, nullptr when free
+    int m_carved;        // nodes carved, kept once the slab is no longer the last of its pool
+    uint32_t m_nextFree; // next free slab id while on the free list
+};
+static PostNode sentinelSlab[1];
+PostNode* slabTable[MAXSLABS] = {sentinelSlab};
+static SlabInfo slabInfo[MAXSLABS];
+static mutex slabLock;
+static uint32_t freeSlabs = 0; // first free slab id, 0 when none
+static uint32_t nextSlab = 1;  // lowest id never handed out
+
+PostPool::PostPool(int initialSize) {
+  m_carved = 0;
+  m_slabSize = 0;
+  m_capacity = 0;
+  m_freeList = m_freeTail = NULLNODE;
+  m_numFree = 0;
+  m_initialSize = (initialSize > 0 ? initialSize : DEFAULTPOOLSIZE);
+}
+
+PostPool::~PostPool() {
+  releaseAll();
+}
+
+// Hand out a node, preferring the free list over carving a new one
+nodeid_t PostPool::allocate(const Post& post) {
+  nodeid_t id = takeSlot();
+  PostNode& node = this->node(id);
+  node.setPost(post);
+  node.setNpl(0);
+  node.setWindow(0);
+  node.m_key = 0;
+  node.m_left = node.m_right = node.m_parent = NULLNODE;
+  return id;
+}
+
+nodeid_t PostPool::emplace(int ID, int likes, int connectLevel, int postTime, int interestLevel) {
+  nodeid_t id = takeSlot();
+  PostNode& node = this->node(id);
+  node.setPost(ID, likes, connectLevel, postTime, interestLevel);
+  node.setNpl(0);
+  node.setWindow(0);
+  node.m_key = 0;
+  node.m_left = node.m_right = node.m_parent = NULLNODE;
+  return id;
+}
+
+// node is taken by value, it may live in this pool's first slab
+nodeid_t PostPool::allocate(PostNode node) {
+  nodeid_t id = takeSlot();
+  node.m_left = node.m_right = node.m_parent = NULLNODE;
+  this->node(id) = node;
+  return id;
+}
+
+// Unlink a free node or carve a new one
+nodeid_t PostPool::takeSlot() {
+  SQUEUE_STAT(m_allocations++);
+  if (m_freeList != NULLNODE) {
+    nodeid_t id = m_freeList;
+    m_freeList = node(id).m_right;
+    if (m_freeList == NULLNODE) m_freeTail = NULLNODE;
+    m_numFree--;
+    return id;
+  }
+  if (m_carved == m_slabSize) addSlab();
+  m_capacity++;
+  return (nodeid_t)((m_slabs.back() << SLABBITS) | (uint32_t)m_carved++);
+}
+
+// The last slab doubles in place until it is full, its ids stay the same.
+// Once it is full a new slab is taken from the registry.
+void PostPool::addSlab() {
+  if (!m_slabs.empty() && m_slabSize < SLABSIZE) {
+    int size = min(m_slabSize * 2, SLABSIZE);
+    uint32_t slab = m_slabs.back();
+    PostNode* grown = new PostNode[size];
+    copy(slabTable[slab], slabTable[slab] + m_carved, grown);
+    delete[] slabTable[slab];
+    slabTable[slab] = grown;
+    m_slabSize = size;
+    return;
+  }
+  int size = (m_slabs.empty() ? min(m_initialSize, SLABSIZE) : SLABSIZE);
+  m_slabs.reserve(m_slabs.size() + 1);
+  unique_ptr<PostNode[]> base(new PostNode[size]);
+  uint32_t slab;
+  {
+    lock_guard<mutex> lock(slabLock);
+    if (freeSlabs != 0) {
+      slab = freeSlabs;
+      freeSlabs = slabInfo[slab].m_nextFree;
+    } else if (nextSlab < (uint32_t)MAXSLABS) {
+      slab = nextSlab++;
+    } else {
+      throw bad_alloc();
+    }
+  }
+  if (!m_slabs.empty()) slabInfo[m_slabs.back()].m_carved = m_carved;
+  slabTable[slab] = base.release();
+  slabInfo[slab].m_owner = this;
+  m_slabs.push_back(slab);
+  m_carved = 0;
+  m_slabSize = size;
+}
+
+// Push a node on the free list; the slot stays in its slab. A free node
+// is its own parent, which no linked node ever is (see isFree).
+void PostPool::release(nodeid_t id) {
+  PostNode& node = this->node(id);
+  node.m_parent = id;
+  node.m_left = NULLNODE;
+  node.m_right = m_freeList;
+  if (m_freeList == NULLNODE) m_freeTail = id;
+  m_freeList = id;
+  m_numFree++;
+}
+
+// Chain ids together and splice the chain onto the free list
+void PostPool::release(const vector<nodeid_t>& ids) {
+  if (ids.empty()) return;
+  for (size_t i = 0; i < ids.size(); i++) {
+    PostNode& node = this->node(ids[i]);
+    node.m_parent = ids[i];
+    node.m_left = NULLNODE;
+    node.m_right = (i + 1 < ids.size() ? ids[i + 1] : m_freeList);
+  }
+  if (m_freeList == NULLNODE) m_freeTail = ids.back();
+  m_freeList = ids[0];
+  m_numFree += (int)ids.size();
+}
+
+// Give every slab back to the registry at once
+void PostPool::releaseAll() {
+  if (m_slabs.empty()) return;
+  for (uint32_t slab : m_slabs) {
+    delete[] slabTable[slab];
+    slabTable[slab] = nullptr;
+  }
+  {
+    lock_guard<mutex> lock(slabLock);
+    for (uint32_t slab : m_slabs) {
+      slabInfo[slab] = SlabInfo{nullptr, 0, freeSlabs};
+      freeSlabs = slab;
+    }
+  }
+  m_slabs.clear();
+  m_carved = m_slabSize = m_capacity = 0;
+  m_freeList = m_freeTail = NULLNODE;
+  m_numFree = 0;
+}
+
+// Move rhs's slab ids over and splice its free list in front of ours.
+// Only one slab of the result can be carved from, the one with more room
+// left; the uncarved rest of the other stays unused.
+void PostPool::adopt(PostPool& rhs) {
+  if (this == &rhs || rhs.m_slabs.empty()) return;
+  if (m_slabs.empty()) {
+    // Nothing here yet, simply take rhs's slabs.
+    m_slabs.swap(rhs.m_slabs);
+    swap(m_carved, rhs.m_carved);
+    swap(m_slabSize, rhs.m_slabSize);
+    swap(m_capacity, rhs.m_capacity);
+    swap(m_freeList, rhs.m_freeList);
+    swap(m_freeTail, rhs.m_freeTail);
+    swap(m_numFree, rhs.m_numFree);
+  } else {
+    bool keepLast = (m_slabSize - m_carved >= rhs.m_slabSize - rhs.m_carved);
+    if (keepLast) {
+      m_slabs.insert(m_slabs.end() - 1, rhs.m_slabs.begin(), rhs.m_slabs.end());
+      slabInfo[rhs.m_slabs.back()].m_carved = rhs.m_carved;
+    } else {
+      m_slabs.insert(m_slabs.end(), rhs.m_slabs.begin(), rhs.m_slabs.end());
+      slabInfo[m_slabs[m_slabs.size() - rhs.m_slabs.size() - 1]].m_carved = m_carved;
+      m_carved = rhs.m_carved;
+      m_slabSize = rhs.m_slabSize;
+    }
+    if (rhs.m_freeList != NULLNODE) {
+      node(rhs.m_freeTail).m_right = m_freeList;
+      if (m_freeList == NULLNODE) m_freeTail = rhs.m_freeTail;
+      m_freeList = rhs.m_freeList;
+      m_numFree += rhs.m_numFree;
+    }
+    m_capacity += rhs.m_capacity;
+    rhs.m_slabs.clear();
+    rhs.m_carved = rhs.m_slabSize = rhs.m_capacity = 0;
+    rhs.m_freeList = rhs.m_freeTail = NULLNODE;
+    rhs.m_numFree = 0;
+  }
+  for (uint32_t slab : m_slabs) slabInfo[slab].m_owner = this;
+}
+
+bool PostPool::owns(nodeid_t id) const {
+  uint32_t slab = id >> SLABBITS;
+  if (id == NULLNODE || slabInfo[slab].m_owner != this) return false;
+  int carved = (slab == m_slabs.back() ? m_carved : slabInfo[slab].m_carved);
+  return ((int)(id & SLABMASK) < carved);
+}
+
+int PostPool::capacity() const {
+  return m_capacity;
+}
+
+int PostPool::numFree() const {
+  return m_numFree;
+}
+
+// --- HeapEngine ---
+// Copy a tree, iterative preorder. Each stack entry is a source node, the
+// copy of its parent and which child of the parent it becomes.
+nodeid_t HeapEngine::copyTree(PostPool& from, nodeid_t root, PostPool& to) {
+  struct CopyStep {nodeid_t src; nodeid_t parent; bool left;};
+  nodeid_t copyRoot = NULLNODE;
+  vector<CopyStep> stack;
+  if (root != NULLNODE) stack.push_back(CopyStep{root, NULLNODE, false});
+  while (!stack.empty()) {
+    CopyStep step = stack.back();
+    stack.pop_back();
+    nodeid_t copy = to.allocate(from.node(step.src));
+    to.node(copy).m_parent = step.parent;
+    if (step.parent == NULLNODE) copyRoot = copy;
+    else if (step.left) to.node(step.parent).m_left = copy;
+    else to.node(step.parent).m_right = copy;
+    const PostNode& src = from.node(step.src);
+    if (src.m_right != NULLNODE) stack.push_back(CopyStep{src.m_right, copy, false});
+    if (src.m_left != NULLNODE) stack.push_back(CopyStep{src.m_left, copy, true});
+  }
+  return copyRoot;
+}
+
+// Release every node of a tree back to pool.
+// Rotates left children up until the node has none, so no stack is needed.
+void HeapEngine::releaseTree(PostPool& pool, nodeid_t root) {
+  nodeid_t id = root;
+  while (id != NULLNODE) {
+    PostNode& node = pool.node(id);
+    if (node.m_left != NULLNODE) {
+      nodeid_t left = node.m_left;
+      node.m_left = pool.node(left).m_right;
+      pool.node(left).m_right = id;
+      id = left;
+    } else {
+      nodeid_t right = node.m_right;
+      pool.release(id);
+      id = right;
+    }
+  }
+}
+
+// Level-order walk that detaches nodes. ids doubles as the traversal
+// queue: children are appended and visited in turn.
+void HeapEngine::detachTree(NodeTable nodes, nodeid_t root, vector<nodeid_t>& ids) {
+  size_t next = ids.size();
+  if (root != NULLNODE) ids.push_back(root);
+  while (next < ids.size()) {
+    PostNode& node = nodes[ids[next++]];
+    if (node.m_left != NULLNODE) ids.push_back(node.m_left);
+    if (node.m_right != NULLNODE) ids.push_back(node.m_right);
+    node.m_left = node.m_right = node.m_parent = NULLNODE;
+    node.setNpl(0);
+  }
+}
+
+void HeapEngine::clearHeap(nodeid_t heap, shared_ptr<PostPool>& pool) {
+  if (!pool) return; // moved-from queue, owns nothing
+  if (pool.use_count() == 1) {
+    // We own every node in the pool, free the slabs without a walk.
+    pool->releaseAll();
+  } else {
+    releaseTree(*pool, heap);
+  }
+}
+
+nodeid_t HeapEngine::transferHeap(nodeid_t heap, shared_ptr<PostPool>& from, shared_ptr<PostPool>& to) {
+  if (heap == NULLNODE) return NULLNODE;
+  if (from == to) return heap;
+  if (from.use_count() == 1) {
+    // from is used by a single queue, take over its slabs. Ids stay the same.
+    to->adopt(*from);
+    return heap;
+  }
+  // Other queues still live in from, copy the nodes over.
+  nodeid_t copy = copyTree(*from, heap, *to);
+  releaseTree(*from, heap);
+  return copy;
+}
+
+void HeapEngine::transferNodes(vector<nodeid_t>& ids, shared_ptr<PostPool>& from, shared_ptr<PostPool>& to) {
+  if (ids.empty() || from == to) return;
+  if (from.use_count() == 1) {
+    to->adopt(*from);
+    return;
+  }
+  for (nodeid_t& id : ids) {
+    nodeid_t copy = to->allocate(from->node(id));
+    from->release(id);
+    id = copy;
+  }
+}
+
+// --- BucketIndex ---
+BucketIndex::BucketIndex() {
+  m_minKey = 1;
+  m_maxKey = 0;
+  m_count = 0;
+}
+
+// Size the arrays for [minKey, maxKey], an empty range means no buckets
+void BucketIndex::reset(int minKey, int maxKey) {
+  release();
+  m_minKey = minKey;
+  m_maxKey = maxKey;
+  if (minKey > maxKey) return;
+  int numBuckets = maxKey - minKey + 1;
+  int numWords = (numBuckets + 63) / 64;
+  m_head.assign(numBuckets, NULLNODE);
+  m_tail.assign(numBuckets, NULLNODE);
+  m_bits.assign(numWords, 0);
+  m_summary.assign((numWords + 63) / 64, 0);
+}
+
+void BucketIndex::clear() {
+  fill(m_head.begin(), m_head.end(), NULLNODE);
+  fill(m_tail.begin(), m_tail.end(), NULLNODE);
+  fill(m_bits.begin(), m_bits.end(), 0);
+  fill(m_summary.begin(), m_summary.end(), 0);
+  m_count = 0;
+}
+
+void BucketIndex::release() {
+  vector<nodeid_t>().swap(m_head);
+  vector<nodeid_t>().swap(m_tail);
+  vector<uint64_t>().swap(m_bits);
+  vector<uint64_t>().swap(m_summary);
+  m_minKey = 1;
+  m_maxKey = 0;
+  m_count = 0;
+}
+
+// Append a detached node to the bucket of its key
+void BucketIndex::push(NodeTable nodes, nodeid_t id) {
+  int bucket = nodes[id].m_key - m_minKey;
+  nodes[id].m_left = nodes[id].m_right = nodes[id].m_parent = NULLNODE;
+  nodes[id].setNpl(0);
+  if (m_head[bucket] == NULLNODE) {
+    m_head[bucket] = id;
+    m_bits[bucket / 64] |= uint64_t(1) << (bucket % 64);
+    m_summary[bucket / 4096] |= uint64_t(1) << (bucket / 64 % 64);
+  } else {
+    nodes[m_tail[bucket]].m_right = id;
+  }
+  m_tail[bucket] = id;
+  m_count++;
+}
+
+int BucketIndex::bestKey(HEAPTYPE heapType) const {
+  return m_minKey + (heapType == MINHEAP ? firstBucket() : lastBucket());
+}
+
+nodeid_t BucketIndex::pop(NodeTable nodes, HEAPTYPE heapType) {
+  int bucket = (heapType == MINHEAP ? firstBucket() : lastBucket());
+  nodeid_t id = m_head[bucket];
+  m_head[bucket] = nodes[id].m_right;
+  nodes[id].m_right = NULLNODE;
+  if (m_head[bucket] == NULLNODE) {
+    m_tail[bucket] = NULLNODE;
+    clearBit(bucket);
+  }
+  m_count--;
+  return id;
+}
+
+// Walks only the non-empty buckets, found through the bitmap
+void BucketIndex::detachAll(NodeTable nodes, vector<nodeid_t>& ids) {
+  for (size_t word = 0; word < m_bits.size(); word++) {
+    uint64_t bits = m_bits[word];
+    while (bits) {
+      int bucket = (int)(word * 64) + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      nodeid_t id = m_head[bucket];
+      while (id != NULLNODE) {
+        ids.push_back(id);
+        nodeid_t next = nodes[id].m_right;
+        nodes[id].m_right = NULLNODE;
+        id = next;
+      }
+      m_head[bucket] = m_tail[bucket] = NULLNODE;
+    }
+    m_bits[word] = 0;
+  }
+  fill(m_summary.begin(), m_summary.end(), 0);
+  m_count = 0;
+}
+
+// Same two-level scan as firstBucket/lastBucket, starting next to key
+bool BucketIndex::nextKey(int& key, HEAPTYPE heapType) const {
+  int numBuckets = (int)m_head.size();
+  int bucket = key - m_minKey + (heapType == MINHEAP ? 1 : -1);
+  if (bucket < 0 || bucket >= numBuckets) return false;
+  long word = bucket / 64;
+  int bit = bucket % 64;
+  uint64_t bits = m_bits[word] & (heapType == MINHEAP ? ~uint64_t(0) << bit
+                                                      : ~uint64_t(0) >> (63 - bit));
+  if (bits == 0) {
+    // Find the next non-empty word through the summary
+    word += (heapType == MINHEAP ? 1 : -1);
+    if (word < 0 || word >= (long)m_bits.size()) return false;
+    long index = word / 64;
+    int shift = word % 64;
+    uint64_t summary = m_summary[index] & (heapType == MINHEAP ? ~uint64_t(0) << shift
+                                                               : ~uint64_t(0) >> (63 - shift));
+    while (summary == 0) {
+      index += (heapType == MINHEAP ? 1 : -1);
+      if (index < 0 || index >= (long)m_summary.size()) return false;
+      summary = m_summary[index];
+    }
+    word = index * 64 + (heapType == MINHEAP ? __builtin_ctzll(summary) : 63 - __builtin_clzll(summary));
+    bits = m_bits[word];
+  }
+  bucket = (int)(word * 64) + (heapType == MINHEAP ? __builtin_ctzll(bits) : 63 - __builtin_clzll(bits));
+  key = m_minKey + bucket;
+  return true;
+}
+
+int BucketIndex::firstBucket() const {
+  for (size_t i = 0; i < m_summary.size(); i++) {
+    if (m_summary[i]) {
+      size_t word = i * 64 + __builtin_ctzll(m_summary[i]);
+      return (int)(word * 64) + __builtin_ctzll(m_bits[word]);
+    }
+  }
+  return -1;
+}
+
+int BucketIndex::lastBucket() const {
+  for (size_t i = m_summary.size(); i-- > 0;) {
+    if (m_summary[i]) {
+      size_t word = i * 64 + 63 - __builtin_clzll(m_summary[i]);
+      return (int)(word * 64) + 63 - __builtin_clzll(m_bits[word]);
+    }
+  }
+  return -1;
+}
+
+void BucketIndex::clearBit(int bucket) {
+  m_bits[bucket / 64] &= ~(uint64_t(1) << (bucket % 64));
+  if (m_bits[bucket / 64] == 0) {
+    m_summary[bucket / 4096] &= ~(uint64_t(1) << (bucket / 64 % 64));
+  }
+}
+
+// --- DaryHeap ---
+template <HEAPTYPE heapType>
+static bool daryBefore(int key1, int key2) {
+  return (heapType == MINHEAP ? key1 < key2 : key1 > key2);
+}
+
+template <HEAPTYPE heapType>
+void DaryHeap::siftUp(size_t pos) {
+  Entry entry = m_entries[pos];
+  while (pos > 0) {
+    size_t parent = (pos - 1) / DARYARITY;
+    if (!daryBefore<heapType>(entry.m_key, m_entries[parent].m_key)) break;
+    m_entries[pos] = m_entries[parent];
+    pos = parent;
+  }
+  m_entries[pos] = entry;
+}
+
+template <HEAPTYPE heapType>
+void DaryHeap::siftDown(size_t pos) {
+  size_t size = m_entries.size();
+  Entry entry = m_entries[pos];
+  while (true) {
+    size_t first = pos * DARYARITY + 1;
+    if (first >= size) break;
+    size_t last = min(first + DARYARITY, size);
+    size_t best = first;
+    for (size_t child = first + 1; child < last; child++) {
+      if (daryBefore<heapType>(m_entries[child].m_key, m_entries[best].m_key)) best = child;
+    }
+    if (!daryBefore<heapType>(m_entries[best].m_key, entry.m_key)) break;
+    m_entries[pos] = m_entries[best];
+    pos = best;
+  }
+  m_entries[pos] = entry;
+}
+
+template <HEAPTYPE heapType>
+void DaryHeap::heapify() {
+  size_t size = m_entries.size();
+  if (size < 2) return;
+  for (size_t pos = (size - 2) / DARYARITY + 1; pos-- > 0;) siftDown<heapType>(pos);
+}
+
+void DaryHeap::push(int key, nodeid_t id, HEAPTYPE heapType) {
+  m_entries.push_back(Entry{key, id});
+  if (heapType == MINHEAP) siftUp<MINHEAP>(m_entries.size() - 1);
+  else siftUp<MAXHEAP>(m_entries.size() - 1);
+}
+
+nodeid_t DaryHeap::pop(HEAPTYPE heapType) {
+  nodeid_t top = m_entries[0].m_id;
+  m_entries[0] = m_entries.back();
+  m_entries.pop_back();
+  if (!m_entries.empty()) {
+    if (heapType == MINHEAP) siftDown<MINHEAP>(0);
+    else siftDown<MAXHEAP>(0);
+  }
+  return top;
+}
+
+// A full heapify is O(n + k) against O(k log n) for k sifts, so it wins
+// once the batch is about as large as the heap.
+void DaryHeap::pushAll(NodeTable nodes, const vector<nodeid_t>& ids, HEAPTYPE heapType) {
+  size_t oldSize = m_entries.size();
+  for (nodeid_t id : ids) m_entries.push_back(Entry{nodes[id].m_key, id});
+  if (ids.size() >= oldSize) {
+    if (heapType == MINHEAP) heapify<MINHEAP>();
+    else heapify<MAXHEAP>();
+  } else {
+    for (size_t pos = oldSize; pos < m_entries.size(); pos++) {
+      if (heapType == MINHEAP) siftUp<MINHEAP>(pos);
+      else siftUp<MAXHEAP>(pos);
+    }
+  }
+}
+
+void DaryHeap::detachAll(vector<nodeid_t>& ids) {
+  for (const Entry& entry : m_entries) ids.push_back(entry.m_id);
+  m_entries.clear();
+}
+
+// --- IndexedHeap ---
+// key1 belongs above key2 in a heap of the given type
+static bool aboveKey(int key1, int key2, HEAPTYPE heapType) {
+  return (heapType == MAXHEAP ? key1 > key2 : key1 < key2);
+}
+
+void IndexedHeap::clear() {
+  for (const Entry& entry : m_entries) posOf(entry.m_id) = -1;
+  m_entries.clear();
+}
+
+void IndexedHeap::release() {
+  vector<Entry>().swap(m_entries);
+  vector<vector<int> >().swap(m_pos);
+}
+
+// Node ids are sparse across slabs, so positions are kept per slab and
+// each slab's array only grows to the highest offset seen.
+int& IndexedHeap::posOf(nodeid_t id) {
+  size_t slab = id >> SLABBITS;
+  size_t offset = id & SLABMASK;
+  if (slab >= m_pos.size()) m_pos.resize(slab + 1);
+  vector<int>& slots = m_pos[slab];
+  if (offset >= slots.size()) slots.resize(offset + 1, -1);
+  return slots[offset];
+}
+
+int IndexedHeap::findPos(nodeid_t id) const {
+  size_t slab = id >> SLABBITS;
+  size_t offset = id & SLABMASK;
+  if (slab >= m_pos.size() || offset >= m_pos[slab].size()) return -1;
+  return m_pos[slab][offset];
+}
+
+// Bottom-up heapify of ids, replacing the current entries
+void IndexedHeap::assign(NodeTable nodes, const vector<nodeid_t>& ids, HEAPTYPE heapType) {
+  clear();
+  for (nodeid_t id : ids) m_entries.push_back(Entry{nodes[id].m_key, id});
+  for (size_t pos = 0; pos < m_entries.size(); pos++) posOf(m_entries[pos].m_id) = (int)pos;
+  for (size_t pos = m_entries.size() / 2; pos-- > 0;) siftDown(pos, heapType);
+}
+
+void IndexedHeap::push(int key, nodeid_t id, HEAPTYPE heapType) {
+  int& slot = posOf(id);
+  m_entries.push_back(Entry{key, id});
+  slot = (int)m_entries.size() - 1;
+  siftUp(m_entries.size() - 1, heapType);
+}
+
+void IndexedHeap::remove(nodeid_t id, HEAPTYPE heapType) {
+  int found = findPos(id);
+  if (found < 0) return;
+  size_t pos = found;
+  posOf(id) = -1;
+  Entry last = m_entries.back();
+  m_entries.pop_back();
+  if (pos == m_entries.size()) return;
+  place(pos, last);
+  siftUp(pos, heapType);
+  siftDown(findPos(last.m_id), heapType);
+}
+
+void IndexedHeap::update(nodeid_t id, int key, HEAPTYPE heapType) {
+  int found = findPos(id);
+  if (found < 0) return;
+  size_t pos = found;
+  m_entries[pos].m_key = key;
+  siftUp(pos, heapType);
+  siftDown(findPos(id), heapType);
+}
+
+void IndexedHeap::place(size_t pos, Entry entry) {
+  m_entries[pos] = entry;
+  m_pos[entry.m_id >> SLABBITS][entry.m_id & SLABMASK] = (int)pos;
+}
+
+void IndexedHeap::siftUp(size_t pos, HEAPTYPE heapType) {
+  Entry entry = m_entries[pos];
+  while (pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if (!aboveKey(entry.m_key, m_entries[parent].m_key, heapType)) break;
+    place(pos, m_entries[parent]);
+    pos = parent;
+  }
+  place(pos, entry);
+}
+
+void IndexedHeap::siftDown(size_t pos, HEAPTYPE heapType) {
+  size_t size = m_entries.size();
+  Entry entry = m_entries[pos];
+  while (2 * pos + 1 < size) {
+    size_t child = 2 * pos + 1;
+    if (child + 1 < size && aboveKey(m_entries[child + 1].m_key, m_entries[child].m_key, heapType)) child++;
+    if (!aboveKey(m_entries[child].m_key, entry.m_key, heapType)) break;
+    place(pos, m_entries[child]);
+    pos = child;
+  }
+  place(pos, entry);
+}
+
+// Default constructor
+SQueue::SQueue() {
+  m_priorFunc = nullptr;
+  m_heapType = MINHEAP;
+  m_structure = SKEW;
+  m_heap = NULLNODE;
+  m_size = 0;
+  m_minKey = 1;
+  m_maxKey = 0;
+  m_refreshKeys = false;
+  m_rebuildBudget = DEFAULTREBUILDBUDGET;
+  m_rebuildThreads = DEFAULTREBUILDTHREADS;
+  m_windowSize = 0;
+  m_window = 0;
+  m_compactedAt = 0;
+  m_expired = 0;
+  m_indexed = false;
+  m_capacity = 0;
+  m_evictValid = true;
+  m_pool = make_shared<PostPool>();
+  selectEngine();
+}
 
 // Constructor
 SQueue::SQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure) {
   m_priorFunc = priFn;
   m_heapType = heapType;
   m_structure = structure;
-  m_heap = nullptr;
+  m_heap = NULLNODE;
   m_size = 0;
+  m_minKey = 1;
+  m_maxKey = 0;
+  m_refreshKeys = false;
+  m_rebuildBudget = DEFAULTREBUILDBUDGET;
+  m_rebuildThreads = DEFAULTREBUILDTHREADS;
+  m_windowSize = 0;
+  m_window = 0;
+  m_compactedAt = 0;
+  m_expired = 0;
+  m_indexed = false;
+  m_capacity = 0;
+  m_evictValid = true;
+  m_pool = make_shared<PostPool>();
+  selectEngine();
+}
+
+// Constructor with a caller supplied (possibly shared) pool
+SQueue::SQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure, shared_ptr<PostPool> pool) {
+  m_priorFunc = priFn;
+  m_heapType = heapType;
+  m_structure = structure;
+  m_heap = NULLNODE;
+  m_size = 0;
+  m_minKey = 1;
+  m_maxKey = 0;
+  m_refreshKeys = false;
+  m_rebuildBudget = DEFAULTREBUILDBUDGET;
+  m_rebuildThreads = DEFAULTREBUILDTHREADS;
+  m_windowSize = 0;
+  m_window = 0;
+  m_compactedAt = 0;
+  m_expired = 0;
+  m_indexed = false;
+  m_capacity = 0;
+  m_evictValid = true;
+  m_pool = (pool ? pool : make_shared<PostPool>());
+  selectEngine();
 }
 
 // --- Destructor ---
@@ -19,32 +756,69 @@ SQueue::~SQueue() {
   clear();
 }
 
-// Clear helper (post-order deletion) 
-void SQueue::clearHelper(Post* node) {
-  if (node) {
-    clearHelper(node->m_left);
-    clearHelper(node->m_right);
-    delete node;
-  }
+// Clear helper (release every node back to the pool)
+void SQueue::clearHelper(nodeid_t node) {
+  HeapEngine::releaseTree(*m_pool, node);
 }
 
 // Clear the entire heap 
 void SQueue::clear() {
-  clearHelper(m_heap);
-  m_heap = nullptr;
+  if (m_pool.use_count() > 1) {
+    // Other queues use the pool, release our nodes one by one. The nodes
+    // are walked in place rather than collected, so clear() never
+    // allocates and the move assignment can call it.
+    for (nodeid_t root : m_stale) HeapEngine::releaseTree(*m_pool, root);
+    HeapEngine::releaseTree(*m_pool, m_heap);
+    if (!m_buckets.empty()) {
+      int key = m_buckets.bestKey(m_heapType);
+      do {
+        nodeid_t id = m_buckets.head(key);
+        while (id != NULLNODE) {
+          nodeid_t next = m_pool->node(id).m_right;
+          m_pool->release(id);
+          id = next;
+        }
+      } while (m_buckets.nextKey(key, m_heapType));
+    }
+    m_dary.forEach([this](nodeid_t id) {m_pool->release(id);});
+  } else {
+    HeapEngine::clearHeap(m_heap, m_pool);
+  }
+  m_stale.clear();
+  m_refreshKeys = false;
+  m_index.clear();
+  m_indexed = false;
+  m_evict.clear();
+  m_evictValid = true;
+  m_buckets.clear();
+  m_dary.clear();
+  m_heap = NULLNODE;
   m_size = 0;
+  m_expired = 0;
+  m_windowCounts.assign(m_windowSize, 0);
 }
 
-// Deep copy helper (recursive)
-Post* SQueue::deepCopy(Post* node) {
-  if (!node) return nullptr;
-  Post* newNode = new Post(node->getPostID(), node->getNumLikes(),
-                           node->getConnectLevel(), node->getPostTime(),
-                           node->getInterestLevel());
-  newNode->m_npl = node->m_npl;
-  newNode->m_left = deepCopy(node->m_left);
-  newNode->m_right = deepCopy(node->m_right);
-  return newNode;
+// Deep copy helper
+// Copies the tree, then the buckets in their order or the array heap in
+// array order, so the copy has the same layout. A pending rebuild is
+// copied as pending.
+nodeid_t SQueue::deepCopy(const SQueue& rhs) {
+  if (rhs.m_size + rhs.m_expired == 0) return NULLNODE;
+  ensurePool();
+  for (nodeid_t root : rhs.m_stale) {
+    m_stale.push_back(HeapEngine::copyTree(*rhs.m_pool, root, *m_pool));
+  }
+  m_refreshKeys = rhs.m_refreshKeys;
+  if (!rhs.m_buckets.empty() || !rhs.m_dary.empty()) {
+    // List the ids first, both queues may share one pool that allocate() grows.
+    m_buildList.clear();
+    auto list = [&](nodeid_t id) { m_buildList.push_back(id); };
+    rhs.m_buckets.forEach(rhs.m_pool->nodes(), rhs.m_heapType, list);
+    rhs.m_dary.forEach(list);
+    for (nodeid_t& id : m_buildList) id = m_pool->allocate(rhs.m_pool->node(id));
+    addNodes(m_buildList);
+  }
+  return HeapEngine::copyTree(*rhs.m_pool, rhs.m_heap, *m_pool);
 }
 
 // Copy constructor 
@@ -53,7 +827,25 @@ SQueue::SQueue(const SQueue& rhs) {
   m_heapType = rhs.m_heapType;
   m_structure = rhs.m_structure;
   m_size = rhs.m_size;
-  m_heap = deepCopy(rhs.m_heap);
+  m_minKey = rhs.m_minKey;
+  m_maxKey = rhs.m_maxKey;
+  m_refreshKeys = false;
+  m_rebuildBudget = rhs.m_rebuildBudget;
+  m_rebuildThreads = rhs.m_rebuildThreads;
+  m_linear = rhs.m_linear;
+  m_windowSize = rhs.m_windowSize;
+  m_window = rhs.m_window;
+  m_compactedAt = rhs.m_compactedAt;
+  m_windowCounts = rhs.m_windowCounts;
+  m_expired = rhs.m_expired;
+  m_indexed = false; // rebuilt on the first lookup
+  m_capacity = rhs.m_capacity;
+  m_evictValid = false; // node ids differ in the copy
+  m_pool = make_shared<PostPool>();
+  selectEngine();
+  resetStructure();
+  SQUEUE_STATS_SCOPE(nullptr);
+  m_heap = deepCopy(rhs);
 }
 
 // Assignment operator 
@@ -64,52 +856,266 @@ SQueue& SQueue::operator=(const SQueue& rhs) {
     m_heapType = rhs.m_heapType;
     m_structure = rhs.m_structure;
     m_size = rhs.m_size;
-    m_heap = deepCopy(rhs.m_heap);
+    m_minKey = rhs.m_minKey;
+    m_maxKey = rhs.m_maxKey;
+    m_rebuildBudget = rhs.m_rebuildBudget;
+    m_rebuildThreads = rhs.m_rebuildThreads;
+    m_linear = rhs.m_linear;
+    m_windowSize = rhs.m_windowSize;
+    m_window = rhs.m_window;
+    m_compactedAt = rhs.m_compactedAt;
+    m_windowCounts = rhs.m_windowCounts;
+    m_expired = rhs.m_expired;
+    m_capacity = rhs.m_capacity;
+    m_evictValid = false;
+    selectEngine();
+    resetStructure();
+    SQUEUE_STATS_SCOPE(nullptr);
+    m_heap = deepCopy(rhs);
+  }
+  return *this;
+}
+
+// Move constructor
+SQueue::SQueue(SQueue&& rhs) noexcept
+  : m_mergePath(std::move(rhs.m_mergePath)), m_buildList(std::move(rhs.m_buildList)) {
+  m_priorFunc = rhs.m_priorFunc;
+  m_heapType = rhs.m_heapType;
+  m_structure = rhs.m_structure;
+  m_size = rhs.m_size;
+  m_heap = rhs.m_heap;
+  m_pool = std::move(rhs.m_pool);
+  m_buckets = std::move(rhs.m_buckets);
+  m_dary = std::move(rhs.m_dary);
+  m_stale = std::move(rhs.m_stale);
+  m_refreshKeys = rhs.m_refreshKeys;
+  m_index = std::move(rhs.m_index);
+  m_indexed = rhs.m_indexed;
+  m_evict = std::move(rhs.m_evict);
+  m_evictValid = rhs.m_evictValid;
+  m_capacity = rhs.m_capacity;
+  m_rebuildBudget = rhs.m_rebuildBudget;
+  m_rebuildThreads = rhs.m_rebuildThreads;
+  m_linear = rhs.m_linear;
+  m_windowSize = rhs.m_windowSize;
+  m_window = rhs.m_window;
+  m_compactedAt = rhs.m_compactedAt;
+  m_windowCounts = std::move(rhs.m_windowCounts);
+  m_expired = rhs.m_expired;
+  m_minKey = rhs.m_minKey;
+  m_maxKey = rhs.m_maxKey;
+  m_mergeFn = rhs.m_mergeFn;
+  m_buildFn = rhs.m_buildFn;
+  m_popFn = rhs.m_popFn;
+  m_cutFn = rhs.m_cutFn;
+  rhs.m_heap = NULLNODE;
+  rhs.m_size = 0;
+  rhs.m_buckets.release();
+  rhs.m_dary.release();
+  rhs.m_stale.clear();
+  rhs.m_refreshKeys = false;
+  rhs.m_index.clear();
+  rhs.m_indexed = false;
+  rhs.m_evict.release();
+  rhs.m_evictValid = true;
+  rhs.m_windowSize = 0; // the window counts moved with the nodes
+  rhs.m_expired = 0;
+}
+
+// Move assignment operator
+SQueue& SQueue::operator=(SQueue&& rhs) noexcept {
+  if (this != &rhs) {
+    clear();
+    m_priorFunc = rhs.m_priorFunc;
+    m_heapType = rhs.m_heapType;
+    m_structure = rhs.m_structure;
+    m_size = rhs.m_size;
+    m_heap = rhs.m_heap;
+    m_pool = std::move(rhs.m_pool);
+    m_mergePath = std::move(rhs.m_mergePath);
+    m_buildList = std::move(rhs.m_buildList);
+    m_buckets = std::move(rhs.m_buckets);
+    m_dary = std::move(rhs.m_dary);
+    m_stale = std::move(rhs.m_stale);
+    m_refreshKeys = rhs.m_refreshKeys;
+    m_index = std::move(rhs.m_index);
+    m_indexed = rhs.m_indexed;
+    m_evict = std::move(rhs.m_evict);
+    m_evictValid = rhs.m_evictValid;
+    m_capacity = rhs.m_capacity;
+    m_rebuildBudget = rhs.m_rebuildBudget;
+    m_rebuildThreads = rhs.m_rebuildThreads;
+    m_linear = rhs.m_linear;
+    m_windowSize = rhs.m_windowSize;
+    m_window = rhs.m_window;
+    m_compactedAt = rhs.m_compactedAt;
+    m_windowCounts = std::move(rhs.m_windowCounts);
+    m_expired = rhs.m_expired;
+    m_minKey = rhs.m_minKey;
+    m_maxKey = rhs.m_maxKey;
+    m_mergeFn = rhs.m_mergeFn;
+    m_buildFn = rhs.m_buildFn;
+    m_popFn = rhs.m_popFn;
+    m_cutFn = rhs.m_cutFn;
+    rhs.m_heap = NULLNODE;
+    rhs.m_size = 0;
+    rhs.m_buckets.release();
+    rhs.m_dary.release();
+    rhs.m_stale.clear();
+    rhs.m_refreshKeys = false;
+    rhs.m_index.clear();
+    rhs.m_indexed = false;
+    rhs.m_evict.release();
+    rhs.m_evictValid = true;
+    rhs.m_windowSize = 0;
+    rhs.m_expired = 0;
   }
   return *this;
 }
 
-// Static helper: Compare two posts based on the current priority function and heap type 
-bool SQueue::comparePosts(prifn_t func, HEAPTYPE heapType, const Post* h1, const Post* h2) {
-  int p1 = func(*h1);
-  int p2 = func(*h2);
-  if (heapType == MINHEAP){
-  return (p1 <= p2);  // smaller value = higher priority
-  }else{ 
-  return (p1 >= p2);  // larger value = higher priority
+// A moved-from queue has no pool until it allocates again
+void SQueue::ensurePool() {
+  if (!m_pool) m_pool = make_shared<PostPool>();
+}
+
+// Point m_mergeFn/m_buildFn/m_popFn at the kernels for the current
+// configuration. This is the only place that looks at m_heapType and
+// m_structure, the merge loops themselves are specialized at compile time.
+void SQueue::selectEngine() {
+  if (m_heapType == MINHEAP) selectKernels<MINHEAP>();
+  else selectKernels<MAXHEAP>();
+}
+  
+template <HEAPTYPE heapType>
+void SQueue::selectKernels() {
+  switch (m_structure) {
+  case LEFTIST:
+    m_mergeFn = HeapEngine::merge<heapType, LEFTIST>;
+    m_buildFn = HeapEngine::build<heapType, LEFTIST>;
+    m_popFn = HeapEngine::pop<heapType, LEFTIST>;
+    m_cutFn = HeapEngine::cut<heapType, LEFTIST>;
+    break;
+  case PAIRING:
+    m_mergeFn = HeapEngine::merge<heapType, PAIRING>;
+    m_buildFn = HeapEngine::build<heapType, PAIRING>;
+    m_popFn = HeapEngine::pop<heapType, PAIRING>;
+    m_cutFn = HeapEngine::cut<heapType, PAIRING>;
+    break;
+  default:
+    // SKEW, the fallback heap of BUCKET; DARY never builds a tree
+    m_mergeFn = HeapEngine::merge<heapType, SKEW>;
+    m_buildFn = HeapEngine::build<heapType, SKEW>;
+    m_popFn = HeapEngine::pop<heapType, SKEW>;
+    m_cutFn = HeapEngine::cut<heapType, SKEW>;
+    break;
   }
 }
   
-// Merge two heaps into one 
-Post* SQueue::mergeNodes(Post* h1, Post* h2) {
-  if (!h1) return h2;
-  if (!h2) return h1;
-  
-  // Use comparePosts to decide which root should be on top.
-  if (!comparePosts(m_priorFunc, m_heapType, h1, h2)) {
-    Post* temp = h1;
-    h1 = h2;
-    h2 = temp;
-  }
-  
-  if (m_structure == SKEW) {
-    // Skew heap: swap left and right child after merge.
-    Post* temp = h1->m_left;
-    h1->m_left = mergeNodes(h1->m_right, h2);
-    h1->m_right = temp;
-  } else { // LEFTIST
-    // Leftist heap: merge right subtrees and then ensure leftist property.
-    h1->m_right = mergeNodes(h1->m_right, h2);
-    int nplLeft = (h1->m_left ? h1->m_left->m_npl : 0);
-    int nplRight = (h1->m_right ? h1->m_right->m_npl : 0);
-    if (nplLeft < nplRight) {
-      Post* temp = h1->m_left;
-      h1->m_left = h1->m_right;
-      h1->m_right = temp;
+// Empty structure for the current configuration, nodes must be detached
+void SQueue::resetStructure() {
+  m_heap = NULLNODE;
+  if (m_structure == BUCKET) m_buckets.reset(m_minKey, m_maxKey);
+  else m_buckets.release();
+  if (m_structure == DARY) m_dary.clear();
+  else m_dary.release();
+}
+  
+// True when a post with key1 should leave the queue before key2
+bool SQueue::higherPriority(int key1, int key2) const {
+  return (m_heapType == MINHEAP ? key1 < key2 : key1 > key2);
+}
+  
+// Key of the post getNextPost would return; 0 is never a valid key
+int SQueue::bestKey() {
+  if (m_size == 0) return 0;
+  ensureOrder();
+  skipExpired();
+  return m_pool->node(bestNode()).m_key;
+}
+  
+// The node popRoot would take: ties between a bucket and the fallback
+// heap go to the bucket
+nodeid_t SQueue::bestNode() const {
+  if (m_structure == DARY) return m_dary.nodeAt(0);
+  if (m_buckets.empty()) return m_heap;
+  int bucketKey = m_buckets.bestKey(m_heapType);
+  if (m_heap == NULLNODE || !higherPriority(m_pool->node(m_heap).m_key, bucketKey))
+    return m_buckets.head(bucketKey);
+  return m_heap;
+}
+  
+Post SQueue::peek() {
+  if (m_size == 0) {
+    throw out_of_range("Queue is empty");
+  }
+  ensureOrder();
+  skipExpired();
+  return m_pool->node(bestNode()).getPost();
+}
+  
+optional<Post> SQueue::tryPeek() {
+  if (m_size == 0) return nullopt;
+  return peek();
+}
+  
+vector<Post> SQueue::topK(int k) {
+  vector<Post> posts;
+  OrderedIterator it = orderedPosts();
+  while ((int)posts.size() < k && it.hasNext()) posts.push_back(it.next());
+  return posts;
+}
+  
+OrderedIterator SQueue::orderedPosts() {
+  ensureOrder();
+  return OrderedIterator(*this);
+}
+  
+// Link one detached node with its key set into the current structure
+void SQueue::addNode(nodeid_t node) {
+  if (m_structure == DARY) {
+    m_dary.push(m_pool->node(node).m_key, node, m_heapType);
+  } else if (m_buckets.inRange(m_pool->node(node).m_key)) {
+    m_buckets.push(m_pool->nodes(), node);
+  } else {
+    m_heap = mergeNodes(m_heap, node);
+  }
+}
+  
+// Link detached nodes into the current structure. Trees get the O(n)
+// pairwise build; BUCKET pushes the in-range nodes and builds the rest.
+void SQueue::addNodes(vector<nodeid_t>& nodes) {
+  if (m_structure == DARY) {
+    m_dary.pushAll(m_pool->nodes(), nodes, m_heapType);
+    return;
+  }
+  if (m_structure == BUCKET) {
+    NodeTable base = m_pool->nodes();
+    size_t rest = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      if (m_buckets.inRange(base[nodes[i]].m_key)) m_buckets.push(base, nodes[i]);
+      else nodes[rest++] = nodes[i];
     }
-    h1->m_npl = (h1->m_right ? h1->m_right->m_npl + 1 : 0);
+    nodes.resize(rest);
   }
-  return h1;
+  m_heap = mergeNodes(m_heap, buildHeap(nodes));
+}
+  
+// Detach every node of the queue into nodes, leaving the structure empty
+void SQueue::collectNodes(vector<nodeid_t>& nodes) {
+  if (m_size + m_expired == 0) return;
+  for (nodeid_t root : m_stale) rebuildHelper(root, nodes);
+  m_stale.clear();
+  rebuildHelper(m_heap, nodes);
+  if (!m_buckets.empty()) m_buckets.detachAll(m_pool->nodes(), nodes);
+  m_dary.detachAll(nodes);
+  m_heap = NULLNODE;
+}
+  
+// Merge two heaps into one 
+nodeid_t SQueue::mergeNodes(nodeid_t h1, nodeid_t h2) {
+  if (h1 == NULLNODE) return h2;
+  if (h2 == NULLNODE) return h1;
+  return m_mergeFn(m_pool->nodes(), h1, h2, m_mergePath);
 }
   
 // Merge this queue with another queue
@@ -117,38 +1123,212 @@ void SQueue::mergeWithQueue(SQueue& rhs) {
   if (this == &rhs){ 
     throw domain_error("Cannot merge queue with itself.");
   }
+  SQUEUE_STATS_SCOPE(&m_stats.m_merge);
   // Ensure both queues have the same priority function, heap type, and structure.
   if (m_priorFunc != rhs.m_priorFunc ||
   m_heapType != rhs.m_heapType ||
   m_structure != rhs.m_structure)
   throw domain_error("Incompatible queues cannot be merged.");
+  if (m_windowSize > 0 || rhs.m_windowSize > 0)
+    throw domain_error("Windowed queues cannot be merged.");
   
-  m_heap = mergeNodes(m_heap, rhs.m_heap);
+  ensurePool();
+  ensureOrder();
+  rhs.ensureOrder();
+  if (m_structure == BUCKET || m_structure == DARY) {
+    // Re-add rhs's nodes: each lands in its bucket in O(1), or the
+    // array heap absorbs them with one bottom-up heapify.
+    m_buildList.clear();
+    rhs.collectNodes(m_buildList);
+    HeapEngine::transferNodes(m_buildList, rhs.m_pool, m_pool);
+    addNodes(m_buildList);
+  } else {
+    nodeid_t rhsHeap = HeapEngine::transferHeap(rhs.m_heap, rhs.m_pool, m_pool);
+    m_heap = mergeNodes(m_heap, rhsHeap);
+  }
   m_size += rhs.m_size;
   
-  // Empty the rhs queue.
-  rhs.m_heap = nullptr;
+  // Empty the rhs queue. The adopted nodes are not indexed, so the
+  // index is cleared and rebuilt on the next lookup, which keeps the
+  // merge itself from walking either index.
+  rhs.m_heap = NULLNODE;
   rhs.m_size = 0;
+  rhs.m_indexed = false;
+  rhs.m_evict.clear();
+  m_indexed = false;
+  if (m_capacity > 0) {
+    m_evictValid = false;
+    trimToCapacity();
+  }
+}
+  
+// Tournament merge: in the round with distance stride, queue i absorbs
+// queue i + stride for every i that is a multiple of 2 * stride, so this
+// queue (entry 0) ends up with everything after ceil(log2(n)) rounds.
+void SQueue::mergeAll(const vector<SQueue*>& queues, int numThreads) {
+  vector<SQueue*> players(1, this);
+  for (SQueue* queue : queues) {
+    if (queue == nullptr) throw domain_error("Cannot merge a null queue.");
+    if (m_priorFunc != queue->m_priorFunc ||
+        m_heapType != queue->m_heapType ||
+        m_structure != queue->m_structure)
+      throw domain_error("Incompatible queues cannot be merged.");
+    if (m_windowSize > 0 || queue->m_windowSize > 0)
+      throw domain_error("Windowed queues cannot be merged.");
+    players.push_back(queue);
+  }
+  vector<SQueue*> sorted(players);
+  sort(sorted.begin(), sorted.end());
+  if (adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+    throw domain_error("Cannot merge queue with itself.");
+  // Move every source pool into this queue's pool once, up front. Slab
+  // adoption keeps node ids, so the sources then share this queue's pool
+  // and every merge below is a plain meld that allocates nothing. A pool
+  // also used by queues outside the merge cannot move; those sources are
+  // copied by mergeWithQueue and the rounds stay on this thread.
+  ensurePool();
+  vector<SQueue*> byPool(players.begin() + 1, players.end());
+  sort(byPool.begin(), byPool.end(), [](const SQueue* q1, const SQueue* q2) {
+    return q1->m_pool.get() < q2->m_pool.get();
+  });
+  bool copies = false;
+  vector<SQueue*> adopted; // sources lent this queue's pool for the rounds
+  for (size_t first = 0; first < byPool.size();) {
+    shared_ptr<PostPool> pool = byPool[first]->m_pool;
+    size_t last = first;
+    while (last < byPool.size() && byPool[last]->m_pool == pool) last++;
+    if (pool && pool != m_pool) {
+      // The players in [first, last) and the local pool hold every reference
+      if (pool.use_count() == (long)(last - first) + 1) {
+        m_pool->adopt(*pool);
+        for (size_t i = first; i < last; i++) byPool[i]->m_pool = m_pool;
+        adopted.insert(adopted.end(), byPool.begin() + first, byPool.begin() + last);
+      } else {
+        copies = true;
+      }
+    }
+    first = last;
+  }
+  long long total = 0;
+  for (SQueue* queue : players) total += queue->m_size;
+  bool parallel = (!copies && total >= MINPARALLELMERGE);
+  if (numThreads <= 0) numThreads = max(1, (int)thread::hardware_concurrency());
+  // Nobody trims during the rounds, this queue trims once at the end
+  vector<int> capacities;
+  for (SQueue* queue : players) {
+    capacities.push_back(queue->m_capacity);
+    queue->setCapacity(0);
+  }
+  auto restoreCapacities = [&players, &capacities]() {
+    for (size_t i = 0; i < players.size(); i++) {
+      players[i]->m_capacity = capacities[i];
+      players[i]->m_evictValid = (capacities[i] == 0);
+    }
+  };
+  try {
+    for (size_t stride = 1; stride < players.size(); stride *= 2) {
+      size_t numPairs = (players.size() - 1 - stride) / (2 * stride) + 1;
+      auto mergePair = [&players, stride](size_t pair) {
+        size_t i = pair * 2 * stride;
+        players[i]->mergeWithQueue(*players[i + stride]);
+      };
+      int numWorkers = (parallel ? (int)min((size_t)numThreads, numPairs) : 1);
+      if (numWorkers <= 1) {
+        for (size_t pair = 0; pair < numPairs; pair++) mergePair(pair);
+        continue;
+      }
+      atomic<size_t> next(0);
+      exception_ptr error;
+      mutex errorLock;
+      vector<thread> workers;
+      for (int w = 0; w < numWorkers; w++) {
+        workers.emplace_back([&]() {
+          for (size_t pair = next++; pair < numPairs; pair = next++) {
+            try {
+              mergePair(pair);
+            } catch (...) {
+              lock_guard<mutex> lock(errorLock);
+              if (!error) error = current_exception();
+            }
+          }
+        });
+      }
+      for (thread& worker : workers) worker.join();
+      if (error) rethrow_exception(error);
+    }
+  } catch (...) {
+    restoreCapacities();
+    throw;
+  }
+  restoreCapacities();
+  // The emptied sources get a pool of their own again when they need one
+  for (SQueue* queue : adopted) queue->m_pool.reset();
+  if (m_capacity > 0) trimToCapacity();
 }
   
 // Insert a Post into the queue
-bool SQueue::insertPost(const Post& post) {
+PostHandle SQueue::insertPost(const Post& post) {
   // Check validity via the priority function; if invalid (0) then do not insert.
-  if (m_priorFunc(post) == 0){ 
-    return false;
+  // The priority is computed only here and cached in the node.
+  SQUEUE_STATS_SCOPE(&m_stats.m_insert);
+  int key = m_priorFunc(post);
+  SQUEUE_STAT(m_priorityCalls++);
+  if (key == 0 || !makeRoom(key)){ 
+    return PostHandle();
   }
   // Create a new node (copy of post)
-  Post* newNode = new Post(post.getPostID(), post.getNumLikes(),
-                          post.getConnectLevel(), post.getPostTime(),
-                          post.getInterestLevel());
-  newNode->m_left = newNode->m_right = nullptr;
-  newNode->m_npl = 0;
+  ensurePool();
+  nodeid_t newNode = m_pool->allocate(post);
+  m_pool->node(newNode).m_key = key;
+  return linkNewNode(newNode);
+}
   
-  m_heap = mergeNodes(m_heap, newNode);
-  m_size++;
+// Pack the fields into a pool node and key it from there. A rejected
+// node goes straight back to the pool.
+PostHandle SQueue::emplacePost(int ID, int likes, int connectLevel, int postTime, int interestLevel) {
+  SQUEUE_STATS_SCOPE(&m_stats.m_insert);
+  ensurePool();
+  nodeid_t newNode = m_pool->emplace(ID, likes, connectLevel, postTime, interestLevel);
+  int key = m_priorFunc(m_pool->node(newNode).getPost());
+  SQUEUE_STAT(m_priorityCalls++);
+  if (key == 0 || !makeRoom(key)) {
+    m_pool->release(newNode);
+    return PostHandle();
+  }
+  m_pool->node(newNode).m_key = key;
+  return linkNewNode(newNode);
+}
+  
+// Full: the new post replaces the worst one only if it ranks higher.
+// The cut needs the worst node in m_heap, not in a stale subtree of a
+// pending rebuild, so the rebuild is finished first.
+bool SQueue::makeRoom(int key) {
+  if (m_capacity == 0) return true;
+  ensureEvictIndex();
+  if (m_size < m_capacity) return true;
+  if (!higherPriority(key, m_evict.topKey())) return false;
+  ensureOrder();
+  eraseNode(m_evict.top());
   return true;
 }
   
+PostHandle SQueue::linkNewNode(nodeid_t node) {
+  int key = m_pool->node(node).m_key;
+  int postID = m_pool->node(node).getPostID();
+  if (m_windowSize > 0) stampNode(node);
+  addNode(node);
+  if (m_indexed) m_index[postID] = node;
+  if (m_capacity > 0) m_evict.push(key, node, evictOrder());
+  if (!m_stale.empty()) rebuildStep(m_rebuildBudget);
+  m_size++;
+  return PostHandle(node, postID);
+}
+  
+// Insert a vector of posts in one batch
+int SQueue::insertPosts(const vector<Post>& posts) {
+  return insertPosts(posts.begin(), posts.end());
+}
+  
 // Return the number of posts in the queue 
 int SQueue::numPosts() const {
   return m_size;
@@ -159,36 +1339,671 @@ prifn_t SQueue::getPriorityFn() const {
   return m_priorFunc;
 }
   
+// Detach the root into post and merge its subtrees.
+void SQueue::popRoot(Post& post) {
+  ensureOrder();
+  skipExpired();
+  nodeid_t best = detachBest();
+  post = m_pool->node(best).getPost();
+  unindex(best);
+  if (m_capacity > 0) m_evict.remove(best, evictOrder());
+  if (forgetNode(best)) m_size--;
+  m_pool->release(best);
+}
+  
+// Unlink the best node from the array heap, its bucket or the tree. The
+// node keeps its post and key, the caller releases it.
+nodeid_t SQueue::detachBest() {
+  if (m_structure == DARY) return m_dary.pop(m_heapType);
+  if (!m_buckets.empty() &&
+      (m_heap == NULLNODE || !higherPriority(m_pool->node(m_heap).m_key, m_buckets.bestKey(m_heapType)))) {
+    return m_buckets.pop(m_pool->nodes(), m_heapType);
+  }
+  nodeid_t oldRoot = m_heap;
+  // Merge the subtrees, or pair up the children of a pairing heap
+  m_heap = m_popFn(m_pool->nodes(), oldRoot, m_mergePath);
+  return oldRoot;
+}
+  
+// The best count nodes of a heap-ordered tree are a connected top part
+// of it. They are found with a small frontier heap, like OrderedIterator,
+// without touching any links, and the subtrees left hanging below them
+// are melded once at the end instead of after every pop. Expired nodes
+// on the way are dropped with the others but not returned.
+void SQueue::extractTop(int count, Post* out) {
+  NodeTable nodes = m_pool->nodes();
+  vector<nodeid_t>& frontier = m_buildList;
+  auto lower = [this, nodes](nodeid_t id1, nodeid_t id2) {
+    return higherPriority(nodes[id2].m_key, nodes[id1].m_key);
+  };
+  frontier.clear();
+  frontier.push_back(m_heap);
+  for (int i = 0; i < count;) {
+    pop_heap(frontier.begin(), frontier.end(), lower);
+    nodeid_t best = frontier.back();
+    frontier.pop_back();
+    const PostNode& node = nodes[best];
+    if (!isExpired(best)) out[i++] = node.getPost();
+    m_batchList.push_back(best);
+    if (m_structure == PAIRING) {
+      // Siblings are not ordered among themselves, every child is a candidate
+      for (nodeid_t child = node.m_left; child != NULLNODE; child = nodes[child].m_right) {
+        frontier.push_back(child);
+        push_heap(frontier.begin(), frontier.end(), lower);
+      }
+    } else {
+      nodeid_t children[] = {node.m_left, node.m_right};
+      for (nodeid_t child : children) {
+        if (child == NULLNODE) continue;
+        frontier.push_back(child);
+        push_heap(frontier.begin(), frontier.end(), lower);
+      }
+    }
+  }
+  // Cut the remaining candidates loose. Leftist subtrees keep valid
+  // NPLs, pairing subtrees only lose their sibling link.
+  for (nodeid_t root : frontier) {
+    nodes[root].m_parent = NULLNODE;
+    if (m_structure == PAIRING) nodes[root].m_right = NULLNODE;
+  }
+  m_heap = buildHeap(frontier);
+}
+  
+void SQueue::dropNodes(const vector<nodeid_t>& ids) {
+  int live = 0;
+  for (nodeid_t node : ids) {
+    unindex(node);
+    if (m_capacity > 0) m_evict.remove(node, evictOrder());
+    live += forgetNode(node);
+  }
+  m_pool->release(ids);
+  m_size -= live;
+}
+  
+bool SQueue::removePost(PostHandle handle) {
+  checkTreeStructure();
+  SQUEUE_STATS_SCOPE(nullptr);
+  nodeid_t node = handleNode(handle);
+  if (node == NULLNODE) return false;
+  eraseNode(node);
+  return true;
+}
+  
+bool SQueue::removePost(int postID) {
+  checkTreeStructure();
+  SQUEUE_STATS_SCOPE(nullptr);
+  nodeid_t node = findNode(postID);
+  if (node == NULLNODE) return false;
+  eraseNode(node);
+  return true;
+}
+  
+bool SQueue::updatePost(PostHandle handle, const Post& post) {
+  checkTreeStructure();
+  nodeid_t node = handleNode(handle);
+  if (node == NULLNODE) return false;
+  SQUEUE_STATS_SCOPE(nullptr);
+  int key = m_priorFunc(post);
+  SQUEUE_STAT(m_priorityCalls++);
+  if (key == 0) {
+    eraseNode(node);
+    return false;
+  }
+  updateNode(node, key, post);
+  return true;
+}
+  
+bool SQueue::updatePost(int postID, const Post& post) {
+  checkTreeStructure();
+  return updatePost(PostHandle(findNode(postID), postID), post);
+}
+  
+// Same as updatePost with only the likes changed
+bool SQueue::updateLikes(int postID, int likes) {
+  checkTreeStructure();
+  nodeid_t node = findNode(postID);
+  if (node == NULLNODE) return false;
+  Post post = m_pool->node(node).getPost();
+  post = Post(post.m_postID, likes, post.m_connectLevel, post.m_postTime, post.m_interestLevel);
+  return updatePost(PostHandle(node, postID), post);
+}
+  
+PostHandle SQueue::findPost(int postID) {
+  checkTreeStructure();
+  nodeid_t node = findNode(postID);
+  return (node == NULLNODE ? PostHandle() : PostHandle(node, postID));
+}
+  
+// The index covers the tree once built; pops, removes and updates keep it
+// current and a merge drops it.
+nodeid_t SQueue::findNode(int postID) {
+  if (!m_indexed) {
+    m_index.clear();
+    m_buildList.clear();
+    listNodes(m_buildList);
+    for (nodeid_t id : m_buildList) m_index[m_pool->node(id).getPostID()] = id;
+    m_indexed = true;
+  }
+  unordered_map<int, nodeid_t>::const_iterator it = m_index.find(postID);
+  return (it == m_index.end() || isExpired(it->second) ? NULLNODE : it->second);
+}
+  
+// A node of another pool is rejected by owns(). On a shared pool the node
+// may belong to another queue, so its parent links must lead to this
+// queue's root; the caller has finished any pending rebuild.
+nodeid_t SQueue::handleNode(PostHandle handle) const {
+  if (handle.m_node == NULLNODE || !m_pool || !m_pool->owns(handle.m_node)) return NULLNODE;
+  const PostNode& node = m_pool->node(handle.m_node);
+  if (m_pool->isFree(handle.m_node) || node.getPostID() != handle.m_postID || isExpired(handle.m_node)) return NULLNODE;
+  if (m_pool.use_count() > 1) {
+    nodeid_t root = handle.m_node;
+    while (m_pool->node(root).m_parent != NULLNODE) root = m_pool->node(root).m_parent;
+    if (root != m_heap) return NULLNODE;
+  }
+  return handle.m_node;
+}
+  
+// Cuts need parent links, which only the trees keep. Also finishes a
+// pending rebuild so every node is in m_heap.
+void SQueue::checkTreeStructure() {
+  if (m_structure == BUCKET || m_structure == DARY)
+    throw domain_error("Posts can only be changed in SKEW, LEFTIST or PAIRING queues.");
+  ensureOrder();
+}
+  
+void SQueue::unindex(nodeid_t node) {
+  if (!m_indexed) return;
+  unordered_map<int, nodeid_t>::iterator it = m_index.find(m_pool->node(node).getPostID());
+  if (it != m_index.end() && it->second == node) m_index.erase(it);
+}
+  
+// Cut node out, meld its children back in its place and release it
+void SQueue::eraseNode(nodeid_t node) {
+  NodeTable nodes = m_pool->nodes();
+  nodeid_t rest = (node == m_heap ? NULLNODE : m_cutFn(nodes, m_heap, node));
+  nodeid_t children = m_popFn(nodes, node, m_mergePath);
+  m_heap = mergeNodes(rest, children);
+  unindex(node);
+  if (m_capacity > 0) m_evict.remove(node, evictOrder());
+  if (forgetNode(node)) m_size--;
+  m_pool->release(node);
+}
+  
+// A better (or equal) key keeps the subtree in order, so the subtree is
+// cut and melded with the root. A worse key can break the order below,
+// so the node leaves its children behind and is melded back alone.
+void SQueue::updateNode(nodeid_t node, int key, const Post& post) {
+  NodeTable nodes = m_pool->nodes();
+  if (nodes[node].getPostID() != post.getPostID()) {
+    unindex(node);
+    if (m_indexed) m_index[post.getPostID()] = node;
+  }
+  bool better = !higherPriority(nodes[node].m_key, key);
+  nodeid_t rest = (node == m_heap ? NULLNODE : m_cutFn(nodes, m_heap, node));
+  if (!better) {
+    rest = mergeNodes(rest, m_popFn(nodes, node, m_mergePath));
+    nodes[node].m_left = nodes[node].m_right = NULLNODE;
+    nodes[node].setNpl(0);
+  }
+  nodes[node].setPost(post);
+  nodes[node].m_key = key;
+  m_heap = mergeNodes(rest, node);
+  if (m_capacity > 0) m_evict.update(node, key, evictOrder());
+}
+  
+void SQueue::setCapacity(int maxPosts) {
+  if (maxPosts < 0) throw domain_error("Capacity cannot be negative.");
+  if (maxPosts > 0 && m_windowSize > 0) throw domain_error("A windowed queue cannot be bounded.");
+  if (maxPosts > 0) checkTreeStructure();
+  m_capacity = maxPosts;
+  if (m_capacity == 0) {
+    m_evict.release();
+    m_evictValid = true;
+    return;
+  }
+  m_evictValid = false;
+  SQUEUE_STATS_SCOPE(nullptr);
+  trimToCapacity();
+}
+  
+int SQueue::getCapacity() const {
+  return m_capacity;
+}
+  
+void SQueue::setWindow(int windows) {
+  if (windows < 0 || windows > MAXWINDOWS) throw domain_error("Window count out of range.");
+  if (m_size + m_expired > 0) throw domain_error("Only an empty queue can change its window.");
+  if (windows > 0 && m_capacity > 0) throw domain_error("A bounded queue cannot be windowed.");
+  m_windowSize = windows;
+  m_windowCounts.assign(windows, 0);
+}
+  
+int SQueue::getWindow() const {
+  return m_windowSize;
+}
+  
+// Each step moves the live count of the window falling out to m_expired,
+// the nodes themselves are not touched
+void SQueue::advanceWindow(int steps) {
+  if (m_windowSize == 0) throw domain_error("The queue is not windowed.");
+  if (steps < 0) throw domain_error("Cannot go back to an earlier window.");
+  if (steps >= m_windowSize) {
+    // Every post expires, nothing to skip later
+    clear();
+    m_window += steps;
+    m_compactedAt = m_window;
+    return;
+  }
+  for (int i = 0; i < steps; i++) {
+    int& count = m_windowCounts[(m_window + 1) % m_windowSize];
+    m_size -= count;
+    m_expired += count;
+    count = 0;
+    m_window++;
+  }
+  // Stamps are 16 bits, so old expired nodes must be gone before they
+  // could look live again
+  if (m_expired == 0) m_compactedAt = m_window;
+  else if (m_expired > m_size || m_window - m_compactedAt >= (uint64_t)WINDOWCOMPACTAGE) compactExpired();
+}
+  
+uint64_t SQueue::currentWindow() const {
+  return m_window;
+}
+  
+void SQueue::compactExpired() {
+  if (m_expired == 0) return;
+  if (m_size == 0) {
+    clear();
+    m_compactedAt = m_window;
+    return;
+  }
+  SQUEUE_STATS_SCOPE(nullptr);
+  ensureOrder();
+  m_buildList.clear();
+  collectNodes(m_buildList);
+  m_batchList.clear();
+  size_t live = 0;
+  for (nodeid_t node : m_buildList) {
+    if (isExpired(node)) {
+      unindex(node);
+      m_batchList.push_back(node);
+    } else {
+      m_buildList[live++] = node;
+    }
+  }
+  m_buildList.resize(live);
+  m_pool->release(m_batchList);
+  m_expired = 0;
+  m_compactedAt = m_window;
+  addNodes(m_buildList);
+}
+  
+int SQueue::numExpired() const {
+  return m_expired;
+}
+  
+bool SQueue::isExpired(nodeid_t node) const {
+  if (m_windowSize == 0) return false;
+  uint64_t age = (m_window - m_pool->node(node).window()) & 0xFFFF;
+  return age >= (uint64_t)m_windowSize;
+}
+  
+void SQueue::stampNode(nodeid_t node) {
+  m_pool->node(node).setWindow(m_window);
+  m_windowCounts[m_window % m_windowSize]++;
+}
+  
+// The caller takes live nodes off m_size, so batches do it once
+bool SQueue::forgetNode(nodeid_t node) {
+  if (isExpired(node)) {
+    m_expired--;
+    return false;
+  }
+  if (m_windowSize > 0) {
+    uint64_t age = (m_window - m_pool->node(node).window()) & 0xFFFF;
+    m_windowCounts[(m_window - age) % m_windowSize]--;
+  }
+  return true;
+}
+  
+// Expired nodes are only skipped when they reach the top, so a pop pays
+// for the stale posts above the best live one and nothing else
+void SQueue::skipExpired() {
+  while (m_expired > 0 && isExpired(bestNode())) {
+    nodeid_t node = detachBest();
+    unindex(node);
+    m_pool->release(node);
+    m_expired--;
+  }
+}
+  
+// Preorder walk of m_heap that leaves the links alone
+void SQueue::listNodes(vector<nodeid_t>& ids) const {
+  size_t next = ids.size();
+  if (m_heap != NULLNODE) ids.push_back(m_heap);
+  while (next < ids.size()) {
+    const PostNode& node = m_pool->node(ids[next++]);
+    if (node.m_left != NULLNODE) ids.push_back(node.m_left);
+    if (node.m_right != NULLNODE) ids.push_back(node.m_right);
+  }
+}
+  
+void SQueue::ensureEvictIndex() {
+  if (m_evictValid) return;
+  ensureOrder();
+  m_buildList.clear();
+  listNodes(m_buildList);
+  m_evict.assign(NodeTable(), m_buildList, evictOrder());
+  m_evictValid = true;
+}
+  
+void SQueue::trimToCapacity() {
+  ensureEvictIndex();
+  while (m_size > m_capacity) eraseNode(m_evict.top());
+}
+  
 // Remove and return the highest priority Post
 Post SQueue::getNextPost() {
-  if (!m_heap){ 
+  if (m_size == 0){ 
   throw out_of_range("Queue is empty");
   }
-  // Save the root post
-  Post result = *m_heap;
-  // Merge the left and right subtrees
-  Post* oldRoot = m_heap;
-  m_heap = mergeNodes(m_heap->m_left, m_heap->m_right);
-  delete oldRoot;
-  m_size--;
+  SQUEUE_STATS_SCOPE(&m_stats.m_pop);
+  Post result;
+  popRoot(result);
   return result;
 }
   
+// Remove the highest priority Post, or return nothing if the queue is empty
+optional<Post> SQueue::tryGetNextPost() {
+  if (m_size == 0) return nullopt;
+  SQUEUE_STATS_SCOPE(&m_stats.m_pop);
+  optional<Post> result(in_place);
+  popRoot(*result);
+  return result;
+}
+  
+// Remove the highest priority Post into a caller supplied Post
+bool SQueue::tryGetNextPost(Post& post) {
+  if (m_size == 0) return false;
+  SQUEUE_STATS_SCOPE(&m_stats.m_pop);
+  popRoot(post);
+  return true;
+}
+  
+// Remove up to k posts, appended to out
+int SQueue::getNextPosts(int k, vector<Post>& out) {
+  int count = max(0, min(k, m_size));
+  size_t first = out.size();
+  out.resize(first + count);
+  return getNextPosts(count, out.data() + first);
+}
+  
+// Remove up to k posts into out[0..k-1]. Trees are drained with one k-way
+// extraction, buckets and the array heap pop one node at a time (both
+// are cheap), and the nodes go back to the pool in one splice.
+int SQueue::getNextPosts(int k, Post* out) {
+  int count = max(0, min(k, m_size));
+  if (count == 0) return 0;
+  SQUEUE_STATS_SCOPE(&m_stats.m_pop);
+  ensureOrder();
+  m_batchList.clear();
+  if (m_structure == DARY || m_structure == BUCKET) {
+    for (int i = 0; i < count; i++) {
+      skipExpired();
+      nodeid_t best = detachBest();
+      out[i] = m_pool->node(best).getPost();
+      m_batchList.push_back(best);
+    }
+  } else {
+    extractTop(count, out);
+  }
+  dropNodes(m_batchList);
+  return count;
+}
+  
 // Change the priority function and rebuild the heap 
 void SQueue::setPriorityFn(prifn_t priFn, HEAPTYPE heapType) {
   m_priorFunc = priFn;
   m_heapType = heapType;
+  m_linear.reset();
+  selectEngine();
   // Rebuild the heap with the new priority function.
-  rebuildHeap();
+  markRebuild(true);
+}
+  
+// The rebuild scores the posts with linear in SIMD blocks
+void SQueue::setPriorityFn(prifn_t priFn, HEAPTYPE heapType, const LinearPriority& linear) {
+  setPriorityFn(priFn, heapType);
+  m_linear = linear;
+}
+  
+void SQueue::setLinearPriority(const LinearPriority& linear) {
+  m_linear = linear;
 }
   
-//  Change the structure (skew/leftist) and rebuild the heap 
+optional<LinearPriority> SQueue::getLinearPriority() const {
+  return m_linear;
+}
+  
+//  Change the structure (skew/leftist/bucket) and rebuild the heap 
 void SQueue::setStructure(STRUCTURE structure) {
+  if (m_capacity > 0 && (structure == BUCKET || structure == DARY))
+    throw domain_error("A bounded queue needs a tree structure.");
   m_structure = structure;
+  selectEngine();
   // Rebuild the heap with the new structure.
   rebuildHeap();
 }
   
+// Declare the BUCKET key range and rebuild if it is in use
+void SQueue::setKeyRange(int minKey, int maxKey) {
+  if (minKey > maxKey || (long long)maxKey - minKey + 1 > MAXBUCKETS)
+    throw domain_error("Invalid key range for BUCKET structure.");
+  m_minKey = minKey;
+  m_maxKey = maxKey;
+  if (m_structure == BUCKET) rebuildHeap();
+}
+  
+// Get the allocator that owns the nodes
+shared_ptr<PostPool> SQueue::getPool() const {
+  return m_pool;
+}
+  
+// --- Snapshots ---
+void SQueue::saveSnapshot(ostream& out) {
+  ensureOrder();
+  compactExpired();
+  vector<SnapshotRecord> records;
+  SnapshotHeader header;
+  SnapshotFormat::initHeader(header);
+  snapshotRecords(records, header.m_numFlat);
+  header.m_heapType = (uint8_t)m_heapType;
+  header.m_structure = (uint8_t)m_structure;
+  header.m_numNodes = (uint32_t)records.size();
+  header.m_minKey = m_minKey;
+  header.m_maxKey = m_maxKey;
+  header.m_capacity = m_capacity;
+  header.m_checksum = SnapshotFormat::checksum(header, records.data(), records.size());
+  out.write((const char*)&header, sizeof(header));
+  out.write((const char*)records.data(), records.size() * sizeof(SnapshotRecord));
+  if (!out) throw domain_error("Cannot write snapshot.");
+}
+  
+void SQueue::saveSnapshot(const string& path) {
+  ofstream out(path, ios::binary | ios::trunc);
+  if (!out) throw domain_error("Cannot open snapshot file " + path);
+  saveSnapshot(out);
+  out.close();
+  if (!out) throw domain_error("Cannot write snapshot file " + path);
+}
+  
+void SQueue::loadSnapshot(istream& in) {
+  SnapshotHeader header;
+  if (!in.read((char*)&header, sizeof(header))) throw domain_error("Snapshot is truncated.");
+  SnapshotFormat::check(header, nullptr, 0);
+  // Read in chunks, so a damaged count fails at the end of the stream
+  // instead of sizing one huge buffer up front
+  const size_t chunk = 1 << 16;
+  vector<SnapshotRecord> records;
+  while (records.size() < header.m_numNodes) {
+    size_t done = records.size();
+    records.resize(min((size_t)header.m_numNodes, done + chunk));
+    if (!in.read((char*)(records.data() + done), (records.size() - done) * sizeof(SnapshotRecord)))
+      throw domain_error("Snapshot is truncated.");
+  }
+  SnapshotFormat::check(header, records.data(), records.size());
+  restoreRecords(header, records);
+}
+  
+void SQueue::loadSnapshot(const string& path) {
+  ifstream in(path, ios::binary);
+  if (!in) throw domain_error("Cannot open snapshot file " + path);
+  loadSnapshot(in);
+}
+  
+// Flat records first, then the tree in preorder. A right child is
+// stacked under its left sibling and patches its index into the parent's
+// record when it is written.
+void SQueue::snapshotRecords(vector<SnapshotRecord>& records, uint32_t& numFlat) const {
+  NodeTable nodes;
+  records.reserve(m_size);
+  auto flat = [&records, nodes](nodeid_t id) {
+    records.push_back(SnapshotRecord{nodes[id].m_fields, nodes[id].m_key, 0});
+  };
+  if (m_structure == DARY) m_dary.forEach(flat);
+  else if (!m_buckets.empty()) m_buckets.forEach(nodes, m_heapType, flat);
+  numFlat = (uint32_t)records.size();
+  if (m_heap == NULLNODE) return;
+  vector<pair<nodeid_t, size_t>> stack; // node, record whose right child it is
+  stack.push_back(make_pair(m_heap, records.size()));
+  while (!stack.empty()) {
+    nodeid_t id = stack.back().first;
+    size_t owner = stack.back().second;
+    stack.pop_back();
+    size_t index = records.size();
+    if (owner != index) records[owner].m_links |= (uint32_t)index;
+    const PostNode& node = nodes[id];
+    records.push_back(SnapshotRecord{node.m_fields, node.m_key, node.m_left != NULLNODE ? SNAPSHOTLEFT : 0});
+    if (node.m_right != NULLNODE) stack.push_back(make_pair(node.m_right, index));
+    if (node.m_left != NULLNODE) stack.push_back(make_pair(node.m_left, index + 1));
+  }
+}
+  
+// records passed SnapshotFormat::check. Every record gets a node first,
+// then the links are set from the flags: record i's left child is i + 1.
+void SQueue::restoreRecords(const SnapshotHeader& header, const vector<SnapshotRecord>& records) {
+  if (header.m_capacity > 0 && m_windowSize > 0)
+    throw domain_error("A windowed queue cannot load a bounded snapshot.");
+  SQUEUE_STATS_SCOPE(nullptr);
+  clear();
+  m_heapType = (HEAPTYPE)header.m_heapType;
+  m_structure = (STRUCTURE)header.m_structure;
+  m_minKey = header.m_minKey;
+  m_maxKey = header.m_maxKey;
+  m_capacity = header.m_capacity;
+  m_evict.release();
+  m_evictValid = (m_capacity == 0);
+  selectEngine();
+  resetStructure();
+  ensurePool();
+  m_buildList.clear();
+  for (const SnapshotRecord& record : records) {
+    m_buildList.push_back(m_pool->allocate(PostNode{record.m_fields, record.m_key, NULLNODE, NULLNODE, NULLNODE}));
+  }
+  NodeTable nodes = m_pool->nodes();
+  size_t numFlat = header.m_numFlat;
+  for (size_t i = 0; i < numFlat; i++) {
+    if (m_structure == DARY) m_dary.append(records[i].m_key, m_buildList[i]);
+    else m_buckets.push(nodes, m_buildList[i]);
+  }
+  for (size_t i = numFlat; i < records.size(); i++) {
+    PostNode& node = nodes[m_buildList[i]];
+    if (records[i].m_links & SNAPSHOTLEFT) {
+      node.m_left = m_buildList[i + 1];
+      nodes[node.m_left].m_parent = m_buildList[i];
+    }
+    if (records[i].m_links & SNAPSHOTRIGHT) {
+      node.m_right = m_buildList[records[i].m_links & SNAPSHOTRIGHT];
+      nodes[node.m_right].m_parent = m_buildList[i];
+    }
+  }
+  m_heap = (numFlat < records.size() ? m_buildList[numFlat] : NULLNODE);
+  m_size = (int)records.size();
+  // A windowed queue takes every loaded post into the current window
+  if (m_windowSize > 0) {
+    for (nodeid_t node : m_buildList) stampNode(node);
+  }
+}
+  
+void SnapshotFormat::initHeader(SnapshotHeader& header) {
+  memset(&header, 0, sizeof(header));
+  memcpy(header.m_magic, "SQUEUE1", 8);
+  header.m_version = SNAPSHOTVERSION;
+}
+  
+// The header is hashed up to m_checksum, its last field, so a flipped
+// heap type, structure or capacity fails like a damaged record
+uint64_t SnapshotFormat::checksum(const SnapshotHeader& header, const SnapshotRecord* records, size_t count) {
+  uint64_t hash = 14695981039346656037ULL;
+  const unsigned char* bytes = (const unsigned char*)&header;
+  for (size_t i = 0; i < offsetof(SnapshotHeader, m_checksum); i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  bytes = (const unsigned char*)records;
+  for (size_t i = 0; i < count * sizeof(SnapshotRecord); i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+  
+// With records null only the header is checked. The tree part is walked
+// the way it was written: each record must be the left child of the one
+// before it, that record's right child, or the right child waiting on top
+// of the stack.
+void SnapshotFormat::check(const SnapshotHeader& header, const SnapshotRecord* records, size_t fileRecords) {
+  SnapshotHeader expected;
+  initHeader(expected);
+  if (memcmp(header.m_magic, expected.m_magic, 8) != 0) throw domain_error("Not an SQueue snapshot.");
+  if (header.m_version != SNAPSHOTVERSION) throw domain_error("Unsupported snapshot version.");
+  if (header.m_heapType > MAXHEAP || header.m_structure > DARY || header.m_capacity < 0 ||
+      header.m_numNodes >= SNAPSHOTRIGHT || header.m_numFlat > header.m_numNodes ||
+      (header.m_structure == DARY && header.m_numFlat != header.m_numNodes) ||
+      (header.m_structure != DARY && header.m_structure != BUCKET && header.m_numFlat != 0) ||
+      (header.m_capacity > 0 && header.m_numNodes > (uint32_t)header.m_capacity) ||
+      (header.m_capacity > 0 && (header.m_structure == BUCKET || header.m_structure == DARY)) ||
+      (long long)header.m_maxKey - header.m_minKey + 1 > MAXBUCKETS)
+    throw domain_error("Bad snapshot header.");
+  if (records == nullptr) return;
+  if (fileRecords < header.m_numNodes) throw domain_error("Snapshot is truncated.");
+  if (checksum(header, records, header.m_numNodes) != header.m_checksum) throw domain_error("Snapshot checksum mismatch.");
+  uint32_t count = header.m_numNodes;
+  for (uint32_t i = 0; i < header.m_numFlat; i++) {
+    bool inRange = (records[i].m_key >= header.m_minKey && records[i].m_key <= header.m_maxKey);
+    if (records[i].m_links != 0 || (header.m_structure == BUCKET && !inRange))
+      throw domain_error("Bad snapshot record.");
+  }
+  vector<uint32_t> pending;
+  uint32_t next = header.m_numFlat;
+  for (uint32_t i = header.m_numFlat; i < count; i++) {
+    uint32_t right = records[i].m_links & SNAPSHOTRIGHT;
+    if (i != next || (right != 0 && (right <= i || right >= count))) throw domain_error("Bad snapshot tree.");
+    if (records[i].m_links & SNAPSHOTLEFT) {
+      if (i + 1 == count) throw domain_error("Bad snapshot tree.");
+      if (right != 0) pending.push_back(right);
+      next = i + 1;
+    } else if (right != 0) {
+      next = right;
+    } else if (!pending.empty()) {
+      next = pending.back();
+      pending.pop_back();
+    } else {
+      next = count;
+    }
+  }
+  if (next != count || !pending.empty()) throw domain_error("Bad snapshot tree.");
+}
+  
 //  Get current structure (SKEW or LEFTIST) 
 STRUCTURE SQueue::getStructure() const {
   return m_structure;
@@ -199,39 +2014,256 @@ HEAPTYPE SQueue::getHeapType() const {
   return m_heapType;
 }
   
-// Static helper: Rebuild helper 
-// Does a preorder traversal, detaches nodes, and merges them into newHeap.
-void SQueue::rebuildHelper(Post* node, Post*& newHeap, SQueue* queuePtr) {
-  if (!node) return;
-  Post* left = node->m_left;
-  Post* right = node->m_right;
-  node->m_left = node->m_right = nullptr;
-  node->m_npl = 0;
-  newHeap = queuePtr->mergeNodes(newHeap, node);
-  rebuildHelper(left, newHeap, queuePtr);
-  rebuildHelper(right, newHeap, queuePtr);
+// Rebuild helper 
+// Detaches every node of the tree and appends it to nodes.
+void SQueue::rebuildHelper(nodeid_t node, vector<nodeid_t>& nodes) {
+  if (node == NULLNODE) return;
+  HeapEngine::detachTree(m_pool->nodes(), node, nodes);
+}
+  
+// Recompute the cached priority of detached nodes after a priority change
+void SQueue::refreshKeys(vector<nodeid_t>& nodes) {
+  if (m_linear) {
+    PostBlock block;
+    int keys[SCOREBLOCK];
+    for (size_t first = 0; first < nodes.size(); first += SCOREBLOCK) {
+      size_t count = min(nodes.size() - first, (size_t)SCOREBLOCK);
+      block.clear();
+      for (size_t i = 0; i < count; i++) block.add(m_pool->node(nodes[first + i]).getPost());
+      scoreBlock(*m_linear, block, keys);
+      for (size_t i = 0; i < count; i++) m_pool->node(nodes[first + i]).m_key = keys[i];
+    }
+    return;
+  }
+  for (nodeid_t id : nodes) {
+    PostNode& node = m_pool->node(id);
+    node.m_key = m_priorFunc(node.getPost());
+    SQUEUE_STAT(m_priorityCalls++);
+  }
+}
+  
+// Score a block of posts for insertPosts and queue the valid ones in
+// m_buildList
+void SQueue::addScored(const Post* posts, int count) {
+  PostBlock block;
+  int keys[SCOREBLOCK];
+  for (int i = 0; i < count; i++) block.add(posts[i]);
+  scoreBlock(*m_linear, block, keys);
+  for (int i = 0; i < count; i++) {
+    if (keys[i] == 0) continue;
+    ensurePool();
+    nodeid_t node = m_pool->allocate(posts[i]);
+    m_pool->node(node).m_key = keys[i];
+    if (m_indexed) m_index[posts[i].getPostID()] = node;
+    m_buildList.push_back(node);
+  }
+}
+  
+// Build a heap from detached single nodes in O(n).
+nodeid_t SQueue::buildHeap(vector<nodeid_t>& nodes) {
+  if (nodes.empty()) return NULLNODE;
+  return m_buildFn(m_pool->nodes(), nodes, m_mergePath);
 }
   
-// Rebuild the heap (used in setPriorityFn and setStructure) 
+// Rebuild the heap (used in setStructure and setKeyRange) 
 void SQueue::rebuildHeap() {
-  Post* newHeap = nullptr;
-  rebuildHelper(m_heap, newHeap, this);
-  m_heap = newHeap;
+  markRebuild(false);
+}
+  
+// Start a lazy rebuild: the current structure is emptied in O(1) for trees
+// (the old root becomes a stale subtree) and O(n) id copies for buckets
+// and the array heap. Nodes already waiting stay where they are, so a run
+// of setPriorityFn/setStructure calls costs no more than one rebuild.
+void SQueue::markRebuild(bool refreshKeys) {
+  m_refreshKeys = (m_refreshKeys || refreshKeys);
+  // Node ids survive a rebuild, only new keys invalidate m_evict.
+  if (refreshKeys && m_capacity > 0) m_evictValid = false;
+  if (m_size + m_expired == 0) {
+    resetStructure();
+    return;
+  }
+  if (m_heap != NULLNODE) m_stale.push_back(m_heap);
+  if (!m_buckets.empty()) m_buckets.detachAll(m_pool->nodes(), m_stale);
+  m_dary.detachAll(m_stale);
+  resetStructure();
 }
   
+// Move up to maxNodes stale nodes into the current structure. The stale
+// subtrees are taken apart top-down, each node's children become stale
+// roots, so every step is O(maxNodes) plus one meld.
+bool SQueue::rebuildStep(int maxNodes) {
+  SQUEUE_STATS_SCOPE(nullptr);
+  m_buildList.clear();
+  NodeTable nodes;
+  while (!m_stale.empty() && (int)m_buildList.size() < maxNodes) {
+    nodeid_t id = m_stale.back();
+    m_stale.pop_back();
+    PostNode& node = nodes[id];
+    if (node.m_left != NULLNODE) m_stale.push_back(node.m_left);
+    if (node.m_right != NULLNODE) m_stale.push_back(node.m_right);
+    node.m_left = node.m_right = node.m_parent = NULLNODE;
+    node.setNpl(0);
+    m_buildList.push_back(id);
+  }
+  if (m_refreshKeys) refreshKeys(m_buildList);
+  addNodes(m_buildList);
+  if (m_stale.empty()) {
+    m_refreshKeys = false;
+    if (!m_buildList.empty()) SQUEUE_STAT(m_rebuilds++);
+  }
+  return !m_stale.empty();
+}
+  
+// Large rebuilds go to parallelRebuild when more than one thread is set
+void SQueue::finishRebuild() {
+  if (m_stale.empty()) return;
+  int numThreads = (m_rebuildThreads > 0 ? m_rebuildThreads : max(1, (int)thread::hardware_concurrency()));
+  int numNodes = m_size + m_expired; // expired nodes are still in the stale subtrees
+  if (numThreads > 1 && numNodes >= MINPARALLELREBUILD) parallelRebuild(numThreads);
+  else rebuildStep(numNodes);
+}
+  
+void SQueue::ensureOrder() {
+  finishRebuild();
+}
+  
+// Finish a pending rebuild on numThreads threads. The stale nodes are
+// detached into one list which is cut into equal chunks, one per worker.
+// Each worker recomputes the keys of its chunk and, for the tree
+// structures, builds its chunk into a sub-heap with the O(n) pairwise
+// build. The sub-heaps are then melded pairwise, log2(numThreads) rounds
+// deep, so the result has the same heap order, NPL values and parent
+// links as a sequential rebuild. BUCKET and DARY only rekey in parallel
+// and push the nodes on this thread. Workers touch nothing but their own
+// nodes and the pool does not grow meanwhile, so no locks are needed.
+void SQueue::parallelRebuild(int numThreads) {
+  SQUEUE_STATS_SCOPE(nullptr);
+  m_buildList.clear();
+  for (nodeid_t root : m_stale) rebuildHelper(root, m_buildList);
+  m_stale.clear();
+  size_t count = m_buildList.size();
+  bool trees = (m_structure == SKEW || m_structure == LEFTIST || m_structure == PAIRING);
+  // A few thousand nodes per worker at least, thread start-up is not free
+  int numWorkers = (int)min((size_t)numThreads, max((size_t)1, count / 4096));
+  vector<nodeid_t> roots(numWorkers, NULLNODE);
+  vector<SQueueStats> workerStats(numWorkers);
+  exception_ptr error;
+  mutex errorLock;
+  NodeTable nodes = m_pool->nodes();
+  auto rebuildChunk = [&](int worker) {
+#ifdef SQUEUE_STATS
+    StatsScope scope(workerStats[worker], nullptr);
+#endif
+    try {
+      vector<nodeid_t> chunk(m_buildList.begin() + count * worker / numWorkers,
+                             m_buildList.begin() + count * (worker + 1) / numWorkers);
+      if (m_refreshKeys) refreshKeys(chunk);
+      if (trees && !chunk.empty()) {
+        vector<nodeid_t> path;
+        roots[worker] = m_buildFn(nodes, chunk, path);
+      }
+    } catch (...) {
+      lock_guard<mutex> lock(errorLock);
+      if (!error) error = current_exception();
+    }
+  };
+  vector<thread> workers;
+  for (int w = 1; w < numWorkers; w++) workers.emplace_back(rebuildChunk, w);
+  rebuildChunk(0);
+  for (thread& worker : workers) worker.join();
+#ifdef SQUEUE_STATS
+  for (const SQueueStats& stats : workerStats) m_stats.addCounters(stats);
+#endif
+  if (error) rethrow_exception(error);
+  if (trees) {
+    // Posts inserted while the rebuild was pending are in m_heap already
+    if (m_heap != NULLNODE) roots.push_back(m_heap);
+    roots.erase(remove(roots.begin(), roots.end(), NULLNODE), roots.end());
+    m_heap = buildHeap(roots);
+  } else {
+    addNodes(m_buildList);
+  }
+  m_refreshKeys = false;
+  if (count > 0) SQUEUE_STAT(m_rebuilds++);
+}
+  
+bool SQueue::rebuildPending() const {
+  return !m_stale.empty();
+}
+  
+void SQueue::setRebuildBudget(int maxNodes) {
+  m_rebuildBudget = max(0, maxNodes);
+}
+  
+int SQueue::getRebuildBudget() const {
+  return m_rebuildBudget;
+}
+  
+void SQueue::setRebuildThreads(int numThreads) {
+  m_rebuildThreads = max(0, numThreads);
+}
+  
+int SQueue::getRebuildThreads() const {
+  return m_rebuildThreads;
+}
+  
+SQueueStats SQueue::stats() const {
+#ifdef SQUEUE_STATS
+  return m_stats;
+#else
+  return SQueueStats();
+#endif
+}
+  
+void SQueue::resetStats() {
+#ifdef SQUEUE_STATS
+  m_stats = SQueueStats();
+#endif
+}
+  
+bool SQueue::statsEnabled() {
+#ifdef SQUEUE_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+  
+// Nodes of a pending rebuild keep their old keys until it reaches them.
+// When the priorities changed those keys are stale, so the prints
+// compute the current one instead of finishing the rebuild.
+int SQueue::printKey(const PostNode& node, bool stale) const {
+  if (!stale || !m_refreshKeys) return node.m_key;
+  return (m_linear ? m_linear->score(node.getPost()) : m_priorFunc(node.getPost()));
+}
+
 // Preorder traversal printing helper for printPostsQueue 
-void SQueue::printPreOrder(Post* node) const {
-  if (!node) return;
-  // Print current node: print priority in [ ] and then the Post details
-  cout << "[" << m_priorFunc(*node) << "] " << *node << "\n";
-  printPreOrder(node->m_left);
-  printPreOrder(node->m_right);
+void SQueue::printPreOrder(nodeid_t node, bool stale) const {
+  vector<nodeid_t> stack;
+  if (node != NULLNODE) stack.push_back(node);
+  while (!stack.empty()) {
+    const PostNode& current = m_pool->node(stack.back());
+    stack.pop_back();
+    // Print current node: print priority in [ ] and then the Post details
+    cout << "[" << printKey(current, stale) << "] " << current.getPost() << "\n";
+    if (current.m_right != NULLNODE) stack.push_back(current.m_right);
+    if (current.m_left != NULLNODE) stack.push_back(current.m_left);
+  }
 }
 
 // Print the posts in the queue using preorder traversal 
+// BUCKET prints its buckets in priority order before the fallback heap.
 void SQueue::printPostsQueue() const {
   cout << "Contents of the queue:" << "\n";
+  auto print = [&](nodeid_t id) {
+    const PostNode& node = m_pool->node(id);
+    cout << "[" << node.m_key << "] " << node.getPost() << "\n";
+  };
+  if (!m_buckets.empty()) m_buckets.forEach(m_pool->nodes(), m_heapType, print);
+  m_dary.forEach(print);
   printPreOrder(m_heap);
+  // Posts of a pending rebuild, still in their old subtrees
+  for (nodeid_t root : m_stale) printPreOrder(root, true);
 }
   
 // Dump functions (for debugging) 
@@ -239,24 +2271,127 @@ void SQueue::dump() const {
   if (m_size == 0) {
     cout << "Empty heap.\n";
   } else {
+    auto print = [&](nodeid_t id) {
+      const PostNode& node = m_pool->node(id);
+      cout << node.m_key << ":" << node.getPostID() << " ";
+    };
+    if (!m_buckets.empty()) m_buckets.forEach(m_pool->nodes(), m_heapType, print);
+    m_dary.forEach(print);
     dump(m_heap);
+    for (nodeid_t root : m_stale) {
+      cout << "| ";
+      dump(root, true);
+    }
   }
   cout << endl;
 }
   
-void SQueue::dump(Post *pos) const {
-  if (pos != nullptr) {
-    cout << "(";
-    dump(pos->m_left);
+// In-order dump with an explicit stack. The second field of an entry
+// tells whether the node's left subtree has already been printed, a
+// NULLNODE entry prints the closing parenthesis of a finished subtree.
+void SQueue::dump(nodeid_t pos, bool stale) const {
+  vector<pair<nodeid_t, bool> > stack;
+  if (pos != NULLNODE) stack.push_back(make_pair(pos, false));
+  while (!stack.empty()) {
+    nodeid_t id = stack.back().first;
+    if (id == NULLNODE) {
+      stack.pop_back();
+      cout << ")";
+      continue;
+    }
+    const PostNode& node = m_pool->node(id);
+    if (!stack.back().second) {
+      cout << "(";
+      stack.back().second = true;
+      if (node.m_left != NULLNODE) stack.push_back(make_pair(node.m_left, false));
+      continue;
+    }
+    stack.pop_back();
     if (m_structure == SKEW){ 
-      cout << m_priorFunc(*pos) << ":" << pos->m_postID;
+      cout << printKey(node, stale) << ":" << node.getPostID();
     }
     else{ 
-      cout << m_priorFunc(*pos) << ":" << pos->m_postID << ":" << pos->m_npl;
-      dump(pos->m_right);
-      cout << ")";
+      cout << printKey(node, stale) << ":" << node.getPostID() << ":" << node.npl();
     }
+    stack.push_back(make_pair(NULLNODE, true));
+    if (node.m_right != NULLNODE) stack.push_back(make_pair(node.m_right, false));
+  }
+}
+  
+// --- OrderedIterator ---
+OrderedIterator::OrderedIterator(const SQueue& queue) {
+  m_queue = &queue;
+  if (queue.m_size == 0) return;
+  if (queue.m_structure == DARY) push(queue.m_dary.keyAt(0), 0, DARYPOS);
+  if (queue.m_heap != NULLNODE) push(queue.m_pool->node(queue.m_heap).m_key, queue.m_heap, TREENODE);
+  if (!queue.m_buckets.empty()) {
+    int key = queue.m_buckets.bestKey(queue.m_heapType);
+    push(key, queue.m_buckets.head(key), BUCKETNODE);
+  }
+  skipExpired();
+}
+  
+Post OrderedIterator::next() {
+  if (m_frontier.empty()) {
+    throw out_of_range("No more posts");
   }
+  nodeid_t id = take();
+  skipExpired();
+  return m_queue->m_pool->node(id).getPost();
+}
+  
+nodeid_t OrderedIterator::take() {
+  auto lower = [this](const Candidate& c1, const Candidate& c2) { return lowerPriority(c1, c2); };
+  pop_heap(m_frontier.begin(), m_frontier.end(), lower);
+  Candidate best = m_frontier.back();
+  m_frontier.pop_back();
+  const SQueue& queue = *m_queue;
+  const PostPool& pool = *queue.m_pool;
+  if (best.m_source == DARYPOS) {
+    size_t first = (size_t)best.m_ref * DARYARITY + 1;
+    size_t size = queue.m_dary.numNodes();
+    for (size_t pos = first; pos < first + DARYARITY && pos < size; pos++) {
+      push(queue.m_dary.keyAt(pos), (nodeid_t)pos, DARYPOS);
+    }
+    return queue.m_dary.nodeAt(best.m_ref);
+  }
+  const PostNode& node = pool.node(best.m_ref);
+  if (best.m_source == BUCKETNODE) {
+    // Same key FIFO first, then the head of the next bucket
+    int key = best.m_key;
+    if (node.m_right != NULLNODE) push(key, node.m_right, BUCKETNODE);
+    else if (queue.m_buckets.nextKey(key, queue.m_heapType)) push(key, queue.m_buckets.head(key), BUCKETNODE);
+  } else if (queue.m_structure == PAIRING) {
+    for (nodeid_t child = node.m_left; child != NULLNODE; child = pool.node(child).m_right) {
+      push(pool.node(child).m_key, child, TREENODE);
+    }
+  } else {
+    if (node.m_left != NULLNODE) push(pool.node(node.m_left).m_key, node.m_left, TREENODE);
+    if (node.m_right != NULLNODE) push(pool.node(node.m_right).m_key, node.m_right, TREENODE);
+  }
+  return best.m_ref;
+}
+  
+// Expired nodes still guard their children, so they are taken like any
+// other candidate, just not returned
+void OrderedIterator::skipExpired() {
+  const SQueue& queue = *m_queue;
+  while (queue.m_expired > 0 && !m_frontier.empty()) {
+    const Candidate& top = m_frontier.front();
+    nodeid_t id = (top.m_source == DARYPOS ? queue.m_dary.nodeAt(top.m_ref) : top.m_ref);
+    if (!queue.isExpired(id)) return;
+    take();
+  }
+}
+  
+void OrderedIterator::push(int key, nodeid_t ref, SOURCE source) {
+  m_frontier.push_back(Candidate{key, ref, source});
+  push_heap(m_frontier.begin(), m_frontier.end(),
+            [this](const Candidate& c1, const Candidate& c2) { return lowerPriority(c1, c2); });
+}
+  
+bool OrderedIterator::lowerPriority(const Candidate& c1, const Candidate& c2) const {
+  return m_queue->higherPriority(c2.m_key, c1.m_key);
 }
   
 ostream& operator<<(ostream& sout, const Post& post) {
@@ -4,11 +4,26 @@
 #include <stdexcept>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <cstdint>
+#include <climits>
+#include <utility>
+#include <unordered_map>
 using namespace std;
 class Grader;   // forward declaration (for grading purposes)
 class Tester;   // forward declaration (for testing purposes)
 class SQueue;   // forward declaration
 class Post;     // forward declaration
+class PostPool; // forward declaration
+struct PostNode; // forward declaration
+struct HeapEngine; // forward declaration
+class BucketIndex; // forward declaration
+class DaryHeap; // forward declaration
+class MultiSQueue; // forward declaration
+class IndexedHeap; // forward declaration
+class OrderedIterator; // forward declaration
 #define DEFAULTPOSTID 100000
 const int MINPOSTID = 100001;//minimum post ID
 const int MAXPOSTID = 999999;//maximum post ID
@@ -20,23 +35,51 @@ const int MINCONLEVEL = 1;//highest priority
 const int MAXCONLEVEL = 5;//lowest priority
 const int MINTIME = 1;//highest priority
 const int MAXTIME = 50;//lowest priority
+const int DEFAULTPOOLSIZE = 64;//nodes reserved by a pool on first use
+const int SLABBITS = 14;//low bits of a node id, the offset inside its slab
+const int SLABSIZE = 1 << SLABBITS;//nodes in a full slab
+const int MAXSLABS = 1 << (32 - SLABBITS);//slabs all pools of the process can hold together
+const int MAXBUCKETS = 1 << 20;//largest key range a BUCKET queue accepts
+const int DARYARITY = 4;//children per node of the DARY array heap
+const int DEFAULTREBUILDBUDGET = 32;//nodes a pending rebuild moves per insert
+const int LATENCYBINS = 32;//bin i of a LatencyHistogram counts [2^i, 2^(i+1)) ns
+const uint32_t SNAPSHOTVERSION = 2;//format version written by saveSnapshot
+const int MINPARALLELMERGE = 16384;//posts a mergeAll round needs before it uses threads
+const int DEFAULTREBUILDTHREADS = 1;//threads finishing a large rebuild, 0 is one per hardware thread
+const int MINPARALLELREBUILD = 65536;//posts a rebuild needs before it uses threads
+const int SCOREBLOCK = 256;//posts scored together by scoreBlock
+const int MAXWINDOWS = 1024;//most windows a windowed queue keeps
+const int WINDOWCOMPACTAGE = 1 << 15;//windows advanced before expired nodes are freed, stamps wrap at 1 << 16
 enum HEAPTYPE {MINHEAP, MAXHEAP};
-enum STRUCTURE {SKEW, LEFTIST};
+// BUCKET keeps one list per key of a declared range (see setKeyRange),
+// PAIRING is a pairing heap and DARY an implicit DARYARITY-ary array heap.
+// PAIRING links two roots in O(1), so insertPost and the meld of
+// mergeWithQueue are O(1). The merge adds O(slabs) when rhs has a pool of
+// its own, and copies rhs in O(size of rhs) when its pool is also used by
+// queues other than this one (see mergeWithQueue).
+enum STRUCTURE {SKEW, LEFTIST, BUCKET, PAIRING, DARY};
+template <class PriorityFn, HEAPTYPE heapType, STRUCTURE structure>
+class BasicSQueue; // forward declaration
 
 // Priority function pointer type
 typedef int (*prifn_t)(const Post&);
 
+// Heap node id, the slab id above SLABBITS and the offset inside the slab
+// below (see PostPool). NULLNODE plays the role of nullptr.
+typedef uint32_t nodeid_t;
+const nodeid_t NULLNODE = 0;
+const nodeid_t SLABMASK = SLABSIZE - 1;
+
 class Post{
     public:
     friend class Grader; // for grading purposes
     friend class Tester; // for testing purposes
     friend class SQueue;
+    friend struct PostNode;
     Post(){
         m_postID = DEFAULTPOSTID;m_likes = MINLIKES;
         m_connectLevel = MAXCONLEVEL;m_postTime = MAXTIME;
         m_interestLevel = MININTERESTLEVEL;
-        m_right = nullptr;
-        m_left = nullptr;
         m_npl = 0;
     }
     Post(int ID, int likes, int connectLevel, int postTime, int interestLevel){
@@ -50,8 +93,6 @@ class Post{
         else m_postTime = postTime;
         if (interestLevel < MININTERESTLEVEL || interestLevel > MAXINTERESTLEVEL) m_interestLevel = MININTERESTLEVEL;
         else m_interestLevel = interestLevel;
-        m_right = nullptr;
-        m_left = nullptr;
         m_npl = 0;
     }
     int getPostID() const {return m_postID;}
@@ -82,61 +123,982 @@ class Post{
     // a value of 10 expresses the highest level of interest 
     int m_interestLevel;    // 1-10, constant variables defined for this
 
-    Post * m_right;   // right child
-    Post * m_left;    // left child
     int m_npl;        // null path length for leftist heap
 };
 
+// PostNode is the heap node stored inside the queues; Post stays the public
+// value type. The post fields, the NPL and the window stamp of a windowed
+// queue are bit-packed into m_fields (the field ranges are bounded by the
+// constants above) and the links are
+// 32-bit indices into the owning PostPool, so a node takes 24 bytes.
+struct PostNode{
+    uint64_t m_fields;  // packed post and NPL, see the field layout below
+    int m_key;          // priority cached by the queue when the node is linked in
+    nodeid_t m_left;    // left child
+    nodeid_t m_right;   // right child, next free node while on the free list
+    nodeid_t m_parent;  // node linking to this one, NULLNODE for a root
+
+    // Field layout of m_fields, lowest bits first
+    static const int IDBITS = 20;       // up to MAXPOSTID
+    static const int LIKESBITS = 9;     // up to MAXLIKES
+    static const int CONLEVELBITS = 3;  // up to MAXCONLEVEL
+    static const int TIMEBITS = 6;      // up to MAXTIME
+    static const int INTERESTBITS = 4;  // up to MAXINTERESTLEVEL
+    static const int NPLBITS = 6;       // NPL of a leftist heap is at most log2(n + 1)
+    static const int NPLSHIFT = IDBITS + LIKESBITS + CONLEVELBITS + TIMEBITS + INTERESTBITS;
+    static const int WINDOWBITS = 16;   // low bits of the window a post was inserted in
+    static const int WINDOWSHIFT = NPLSHIFT + NPLBITS;
+
+    // Keeps the NPL and the window, a node can change its post while linked in
+    void setPost(const Post& post) {
+        m_fields = (m_fields & ~((uint64_t(1) << NPLSHIFT) - 1)) |
+                   (uint64_t)post.m_postID |
+                   (uint64_t)post.m_likes << IDBITS |
+                   (uint64_t)post.m_connectLevel << (IDBITS + LIKESBITS) |
+                   (uint64_t)post.m_postTime << (IDBITS + LIKESBITS + CONLEVELBITS) |
+                   (uint64_t)post.m_interestLevel << (IDBITS + LIKESBITS + CONLEVELBITS + TIMEBITS);
+    }
+    // Packs the fields the way the Post constructor checks them, so the
+    // node holds what setPost(Post(ID, ...)) would store
+    void setPost(int ID, int likes, int connectLevel, int postTime, int interestLevel) {
+        m_fields = (m_fields & ~((uint64_t(1) << NPLSHIFT) - 1)) |
+                   valid(ID, MINPOSTID, MAXPOSTID, DEFAULTPOSTID) |
+                   valid(likes, MINLIKES, MAXLIKES, MINLIKES) << IDBITS |
+                   valid(connectLevel, MINCONLEVEL, MAXCONLEVEL, MAXCONLEVEL) << (IDBITS + LIKESBITS) |
+                   valid(postTime, MINTIME, MAXTIME, MAXTIME) << (IDBITS + LIKESBITS + CONLEVELBITS) |
+                   valid(interestLevel, MININTERESTLEVEL, MAXINTERESTLEVEL, MININTERESTLEVEL) << (IDBITS + LIKESBITS + CONLEVELBITS + TIMEBITS);
+    }
+    Post getPost() const {
+        Post post;
+        post.m_postID = field(0, IDBITS);
+        post.m_likes = field(IDBITS, LIKESBITS);
+        post.m_connectLevel = field(IDBITS + LIKESBITS, CONLEVELBITS);
+        post.m_postTime = field(IDBITS + LIKESBITS + CONLEVELBITS, TIMEBITS);
+        post.m_interestLevel = field(IDBITS + LIKESBITS + CONLEVELBITS + TIMEBITS, INTERESTBITS);
+        return post;
+    }
+    int getPostID() const {return field(0, IDBITS);}
+    int npl() const {return field(NPLSHIFT, NPLBITS);} // null path length for leftist heap
+    void setNpl(int npl) {
+        m_fields = (m_fields & ~(((uint64_t(1) << NPLBITS) - 1) << NPLSHIFT)) | (uint64_t)npl << NPLSHIFT;
+    }
+    int window() const {return field(WINDOWSHIFT, WINDOWBITS);}
+    void setWindow(uint64_t window) {
+        m_fields = (m_fields & ~(((uint64_t(1) << WINDOWBITS) - 1) << WINDOWSHIFT)) |
+                   (window & ((uint64_t(1) << WINDOWBITS) - 1)) << WINDOWSHIFT;
+    }
+
+    private:
+    static uint64_t valid(int value, int low, int high, int fallback) {
+        return (uint64_t)(value < low || value > high ? fallback : value);
+    }
+    int field(int shift, int bits) const {
+        return (int)((m_fields >> shift) & ((uint64_t(1) << bits) - 1));
+    }
+};
+
+// LinearPriority describes a priority function that is a weighted sum of
+// the post fields plus a bias, like priorityFn1 (likes + interest level).
+// Sums outside [m_minKey, m_maxKey] are invalid and score 0, the way a
+// priority function rejects a post. Sums wrap around in 32 bits.
+struct LinearPriority{
+    int m_postID = 0;
+    int m_likes = 0;
+    int m_connectLevel = 0;
+    int m_postTime = 0;
+    int m_interestLevel = 0;
+    int m_bias = 0;
+    int m_minKey = 1;
+    int m_maxKey = INT_MAX;
+    int score(const Post& post) const; // one post, same result as scoreBlock
+};
+
+// Up to SCOREBLOCK posts as one array per field, the layout the SIMD
+// kernels of scoreBlock load from
+struct PostBlock{
+    int m_count = 0;
+    alignas(32) int m_postID[SCOREBLOCK];
+    alignas(32) int m_likes[SCOREBLOCK];
+    alignas(32) int m_connectLevel[SCOREBLOCK];
+    alignas(32) int m_postTime[SCOREBLOCK];
+    alignas(32) int m_interestLevel[SCOREBLOCK];
+    bool full() const {return m_count == SCOREBLOCK;}
+    void clear() {m_count = 0;}
+    void add(const Post& post) {
+        m_postID[m_count] = post.getPostID();
+        m_likes[m_count] = post.getNumLikes();
+        m_connectLevel[m_count] = post.getConnectLevel();
+        m_postTime[m_count] = post.getPostTime();
+        m_interestLevel[m_count] = post.getInterestLevel();
+        m_count++;
+    }
+};
+
+enum SCOREKERNEL {SCALARKERNEL, SSEKERNEL, AVX2KERNEL};
+// Best kernel this CPU runs (SSE is SSE4.1), checked once
+SCOREKERNEL bestScoreKernel();
+// keys[i] = linear.score(post i) for every post of block, with the best
+// kernel or the one given; throws domain_error if the CPU lacks it
+void scoreBlock(const LinearPriority& linear, const PostBlock& block, int* keys);
+void scoreBlock(const LinearPriority& linear, const PostBlock& block, int* keys, SCOREKERNEL kernel);
+
+// Base of every slab by slab id, shared by all pools. Slab 0 holds only
+// the sentinel node.
+extern PostNode* slabTable[MAXSLABS];
+
+// Node lookup for the heap kernels. Node ids are unique in the process,
+// so one table serves every pool and stays valid across allocations.
+struct NodeTable{
+    PostNode& operator[](nodeid_t id) const {return slabTable[id >> SLABBITS][id & SLABMASK];}
+};
+
+// PostPool hands out heap nodes carved from slabs of up to SLABSIZE nodes.
+// A node id is a slab id and an offset, and slab ids are unique in the
+// process, so a slab can move to another pool with its ids and links
+// unchanged; adopt only moves slab ids. The first slab starts at the
+// initial size and doubles up to SLABSIZE, later slabs start full.
+// Released nodes go on a free list (threaded through m_right) for reuse.
+// Id 0 is a sentinel shared by all pools that stands for an empty subtree,
+// always has NPL 0 and is never written.
+// A pool is not thread safe; queues that share one must not be used
+// concurrently. Separate pools can be used from separate threads.
+class PostPool{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+    explicit PostPool(int initialSize = DEFAULTPOOLSIZE);
+    ~PostPool();
+    PostPool(const PostPool&) = delete;
+    PostPool& operator=(const PostPool&) = delete;
+    nodeid_t allocate(const Post& post); // Returns a detached node holding post
+    nodeid_t allocate(PostNode node);    // Returns a detached copy of node (key, npl, fields)
+    // Returns a detached node with the post fields packed in place
+    nodeid_t emplace(int ID, int likes, int connectLevel, int postTime, int interestLevel);
+    void release(nodeid_t id);           // Returns one node to the free list
+    void release(const vector<nodeid_t>& ids); // Same for many nodes in one splice
+    void releaseAll();                   // Frees every slab, invalidates all nodes
+    // Takes over all slabs of rhs, rhs becomes empty. Node ids and links
+    // stay as they are. O(slabs of both pools), no node is copied.
+    void adopt(PostPool& rhs);
+    bool owns(nodeid_t id) const; // id is a node carved from one of this pool's slabs
+    bool isFree(nodeid_t id) const {return node(id).m_parent == id;} // id is on the free list
+    PostNode& node(nodeid_t id) {return slabTable[id >> SLABBITS][id & SLABMASK];}
+    const PostNode& node(nodeid_t id) const {return slabTable[id >> SLABBITS][id & SLABMASK];}
+    // Lookup for the merge kernels. References to nodes are only valid
+    // until the next allocation, which may grow the first slab.
+    NodeTable nodes() const {return NodeTable();}
+    int capacity() const; // Nodes carved, in use or free
+    int numFree() const;  // Nodes ready for reuse without growing
+    int numSlabs() const {return (int)m_slabs.size();}
+
+    private:
+    vector<uint32_t> m_slabs; // slab ids, new nodes are carved from the last one
+    int m_carved;             // nodes carved from the last slab
+    int m_slabSize;           // nodes the last slab has room for
+    int m_capacity;           // nodes carved from all slabs
+    nodeid_t m_freeList;      // released nodes linked through m_right
+    nodeid_t m_freeTail;      // last node of m_freeList, for the splice in adopt
+    int m_numFree;            // length of m_freeList
+    int m_initialSize;        // nodes of the first slab
+
+    nodeid_t takeSlot();      // free list first, then carve from the last slab
+    void addSlab();           // grows the last slab or starts a new one
+};
+
+// Counters and latency histograms of one SQueue. They are collected only
+// when the library is built with SQUEUE_STATS defined (cmake
+// -DSQUEUE_STATS=ON). Otherwise every hook below compiles to nothing and
+// SQueue::stats() returns zeros.
+struct LatencyHistogram{
+    uint64_t m_count = 0;
+    uint64_t m_totalNs = 0;
+    uint64_t m_maxNs = 0;
+    uint64_t m_bins[LATENCYBINS] = {};
+    void record(uint64_t ns);
+    double meanNs() const {return (m_count == 0 ? 0.0 : (double)m_totalNs / m_count);}
+};
+
+struct SQueueStats{
+    uint64_t m_priorityCalls = 0; // calls of the priority function
+    uint64_t m_comparisons = 0;   // key comparisons in the skew/leftist/pairing kernels
+    uint64_t m_merges = 0;        // skew/leftist melds of two non-empty heaps
+    uint64_t m_mergePath = 0;     // nodes on all those meld paths together
+    uint64_t m_maxMergePath = 0;  // longest single meld path
+    uint64_t m_childSwaps = 0;    // left/right exchanges, every skew step and leftist repairs
+    uint64_t m_allocations = 0;   // nodes taken from a pool
+    uint64_t m_rebuilds = 0;      // lazy rebuilds carried to the end
+    LatencyHistogram m_insert;    // insertPost
+    LatencyHistogram m_pop;       // getNextPost, tryGetNextPost and getNextPosts calls
+    LatencyHistogram m_merge;     // mergeWithQueue
+    // O(log n) for a healthy heap. A skew heap that has gone degenerate
+    // (e.g. fed sorted keys) shows up here as a long mean or max path.
+    double meanMergePath() const {return (m_merges == 0 ? 0.0 : (double)m_mergePath / m_merges);}
+    void addMergePath(uint64_t length) {
+        m_merges++;
+        m_mergePath += length;
+        if (length > m_maxMergePath) m_maxMergePath = length;
+    }
+    // Adds the counters of rhs, the histograms are left alone
+    void addCounters(const SQueueStats& rhs) {
+        m_priorityCalls += rhs.m_priorityCalls;
+        m_comparisons += rhs.m_comparisons;
+        m_merges += rhs.m_merges;
+        m_mergePath += rhs.m_mergePath;
+        if (rhs.m_maxMergePath > m_maxMergePath) m_maxMergePath = rhs.m_maxMergePath;
+        m_childSwaps += rhs.m_childSwaps;
+        m_allocations += rhs.m_allocations;
+        m_rebuilds += rhs.m_rebuilds;
+    }
+};
+
+#ifdef SQUEUE_STATS
+// Stats of the SQueue operation running on this thread, null outside one
+extern thread_local SQueueStats* activeStats;
+#define SQUEUE_STAT(update) do { if (activeStats != nullptr) activeStats->update; } while (0)
+
+// Points activeStats at one queue for the length of an operation and
+// records its latency when a histogram is given. Scopes nest.
+class StatsScope{
+    public:
+    StatsScope(SQueueStats& stats, LatencyHistogram* latency);
+    ~StatsScope();
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+    private:
+    SQueueStats* m_saved;
+    LatencyHistogram* m_latency;
+    int64_t m_startNs;
+};
+#define SQUEUE_STATS_SCOPE(latency) StatsScope statsScope(m_stats, latency)
+#else
+#define SQUEUE_STAT(update) do {} while (0)
+#define SQUEUE_STATS_SCOPE(latency) do {} while (0)
+#endif
+
+// HeapEngine holds the merge kernels shared by SQueue and BasicSQueue.
+// Heap order and structure are template parameters, so every combination
+// compiles to its own loop with the comparison and the structure checks
+// resolved at compile time. Keys must already be cached in m_key.
+struct HeapEngine{
+    template <HEAPTYPE heapType>
+    static bool before(const PostNode& h1, const PostNode& h2) {
+        SQUEUE_STAT(m_comparisons++);
+        if (heapType == MINHEAP) return (h1.m_key <= h2.m_key); // smaller value = higher priority
+        else return (h1.m_key >= h2.m_key); // larger value = higher priority
+    }
+    // Meld two heaps; path is scratch space for the leftist unwind
+    template <HEAPTYPE heapType, STRUCTURE structure>
+    static nodeid_t merge(NodeTable nodes, nodeid_t h1, nodeid_t h2, vector<nodeid_t>& path);
+    // Meld detached single nodes pairwise in O(n), ids is overwritten
+    template <HEAPTYPE heapType, STRUCTURE structure>
+    static nodeid_t build(NodeTable nodes, vector<nodeid_t>& ids, vector<nodeid_t>& path);
+    // Meld the subtrees of root, which the caller then releases
+    template <HEAPTYPE heapType, STRUCTURE structure>
+    static nodeid_t pop(NodeTable nodes, nodeid_t root, vector<nodeid_t>& path);
+    // Pairing heap link: the loser becomes the first child of the winner
+    template <HEAPTYPE heapType>
+    static nodeid_t link(NodeTable nodes, nodeid_t h1, nodeid_t h2);
+    // Detach the subtree of node (not the root) from the tree and return the
+    // root of the rest; node keeps its children
+    template <HEAPTYPE heapType, STRUCTURE structure>
+    static nodeid_t cut(NodeTable nodes, nodeid_t root, nodeid_t node);
+
+    // Copy a tree of from into to; from and to may be the same pool
+    static nodeid_t copyTree(PostPool& from, nodeid_t root, PostPool& to);
+    static void releaseTree(PostPool& pool, nodeid_t root);
+    // Detach every node of a tree and append it to ids
+    static void detachTree(NodeTable nodes, nodeid_t root, vector<nodeid_t>& ids);
+    // Release a whole heap; frees the slabs when no other queue uses pool
+    static void clearHeap(nodeid_t heap, shared_ptr<PostPool>& pool);
+    // Make the nodes of heap (owned by from) belong to to; returns the heap
+    // to use afterwards, which is a copy when from is shared with others.
+    static nodeid_t transferHeap(nodeid_t heap, shared_ptr<PostPool>& from, shared_ptr<PostPool>& to);
+    // Same for a list of detached nodes, ids are updated in place
+    static void transferNodes(vector<nodeid_t>& ids, shared_ptr<PostPool>& from, shared_ptr<PostPool>& to);
+};
+
+// BucketIndex keeps one FIFO list of nodes (linked through m_right) per key
+// of a declared range [minKey, maxKey]. A two-level bitmap over the
+// non-empty buckets finds the best key with a couple of word scans, so
+// push is O(1) and pop is O(range / 4096).
+class BucketIndex{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+    BucketIndex();
+    void reset(int minKey, int maxKey); // empty buckets covering the range
+    void clear();                       // empties the buckets, keeps the range
+    void release();                     // frees the arrays, no range
+    bool inRange(int key) const {return (!m_head.empty() && key >= m_minKey && key <= m_maxKey);}
+    bool empty() const {return (m_count == 0);}
+    int numNodes() const {return m_count;}
+    void push(NodeTable nodes, nodeid_t id); // key of id must be in range
+    // Key of the best non-empty bucket, the bucket queue must not be empty
+    int bestKey(HEAPTYPE heapType) const;
+    nodeid_t head(int key) const {return m_head[key - m_minKey];} // first node with key, key in range
+    // Moves key to the next non-empty bucket in priority order, false when none is left
+    bool nextKey(int& key, HEAPTYPE heapType) const;
+    nodeid_t pop(NodeTable nodes, HEAPTYPE heapType); // removes the first node of the best bucket
+    void detachAll(NodeTable nodes, vector<nodeid_t>& ids); // appends every node, empties the buckets
+    // Visits the nodes in priority order, FIFO within a bucket
+    template <class Visit>
+    void forEach(NodeTable nodes, HEAPTYPE heapType, Visit visit) const;
+
+    private:
+    int m_minKey;               // key of bucket 0
+    int m_maxKey;               // key of the last bucket
+    int m_count;                // nodes in all buckets
+    vector<nodeid_t> m_head;    // first node of every bucket
+    vector<nodeid_t> m_tail;    // last node of every bucket
+    vector<uint64_t> m_bits;    // bit b set when bucket b is non-empty
+    vector<uint64_t> m_summary; // bit w set when m_bits[w] is non-zero
+
+    int firstBucket() const;    // lowest non-empty bucket
+    int lastBucket() const;     // highest non-empty bucket
+    void clearBit(int bucket);
+};
+
+// DaryHeap is an implicit DARYARITY-ary heap of (key, node) entries. The key
+// is stored next to the id so sifting never touches the pool, and the
+// children of an entry are adjacent in the array.
+class DaryHeap{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+    void clear() {m_entries.clear();}
+    void release() {vector<Entry>().swap(m_entries);}
+    bool empty() const {return m_entries.empty();}
+    int numNodes() const {return (int)m_entries.size();}
+    int topKey() const {return m_entries[0].m_key;} // the heap must not be empty
+    nodeid_t nodeAt(size_t pos) const {return m_entries[pos].m_id;}
+    int keyAt(size_t pos) const {return m_entries[pos].m_key;}
+    void push(int key, nodeid_t id, HEAPTYPE heapType);
+    nodeid_t pop(HEAPTYPE heapType); // removes the root, the heap must not be empty
+    // Adds detached nodes, heapifying bottom-up when the batch is large
+    void pushAll(NodeTable nodes, const vector<nodeid_t>& ids, HEAPTYPE heapType);
+    // Appends without sifting, the caller keeps the heap order (snapshots)
+    void append(int key, nodeid_t id) {m_entries.push_back(Entry{key, id});}
+    void detachAll(vector<nodeid_t>& ids); // appends every node, empties the heap
+    // Visits the nodes in array order
+    template <class Visit>
+    void forEach(Visit visit) const;
+
+    private:
+    struct Entry{
+        int m_key;
+        nodeid_t m_id;
+    };
+    vector<Entry> m_entries;
+
+    template <HEAPTYPE heapType>
+    void siftUp(size_t pos);
+    template <HEAPTYPE heapType>
+    void siftDown(size_t pos);
+    template <HEAPTYPE heapType>
+    void heapify();
+};
+
+// IndexedHeap is a binary heap of (key, node) entries plus the position of
+// every node, so the top entry is read in O(1) and any node can be removed
+// or re-keyed in O(log n). A bounded SQueue keeps one in the reverse of its
+// own order to find its worst post; each MultiViewSQueue view keeps one in
+// the view's order.
+class IndexedHeap{
+    public:
+    friend class Grader; // for grading purposes
+    friend class Tester; // for testing purposes
+    void clear();
+    void release();
+    bool empty() const {return m_entries.empty();}
+    int numNodes() const {return (int)m_entries.size();}
+    nodeid_t top() const {return m_entries[0].m_id;} // the heap must not be empty
+    int topKey() const {return m_entries[0].m_key;}
+    // heapType is the order of this heap, MAXHEAP keeps the largest key on top
+    void assign(NodeTable nodes, const vector<nodeid_t>& ids, HEAPTYPE heapType);
+    void push(int key, nodeid_t id, HEAPTYPE heapType);
+    void remove(nodeid_t id, HEAPTYPE heapType);
+    void update(nodeid_t id, int key, HEAPTYPE heapType);
+
+    private:
+    struct Entry{
+        int m_key;
+        nodeid_t m_id;
+    };
+    vector<Entry> m_entries;
+    vector<vector<int> > m_pos; // entry of each node id by slab and offset, -1 when not indexed
+
+    int& posOf(nodeid_t id);       // m_pos entry of id, added as -1 if missing
+    int findPos(nodeid_t id) const; // entry of id, -1 when not indexed
+    void place(size_t pos, Entry entry);
+    void siftUp(size_t pos, HEAPTYPE heapType);
+    void siftDown(size_t pos, HEAPTYPE heapType);
+};
+
+// Snapshot file written by SQueue::saveSnapshot: a 48-byte header and one
+// 16-byte record per post, in host byte order. Records are 8-byte aligned
+// so a mapped file can be read in place (see MappedSQueue).
+//   - DARY: the array heap in array order, all records are "flat".
+//   - BUCKET: the bucket nodes in pop order (flat), then the fallback tree.
+//   - Trees: the nodes in preorder. A record has SNAPSHOTLEFT set when
+//     the next record is its left child, and the index of its right child
+//     record in the low bits (0 for none). Pairing heaps store their
+//     left-child/right-sibling form the same way.
+// The NPL travels inside m_fields, so nothing has to be recomputed.
+const uint32_t SNAPSHOTLEFT = uint32_t(1) << 31;
+const uint32_t SNAPSHOTRIGHT = SNAPSHOTLEFT - 1;
+struct SnapshotHeader{
+    char m_magic[8];       // "SQUEUE1" and a zero byte
+    uint32_t m_version;    // SNAPSHOTVERSION
+    uint8_t m_heapType;
+    uint8_t m_structure;
+    uint16_t m_reserved;
+    uint32_t m_numNodes;   // records after the header
+    uint32_t m_numFlat;    // leading records outside the tree
+    int32_t m_minKey;      // BUCKET key range
+    int32_t m_maxKey;
+    int32_t m_capacity;    // 0 when unbounded
+    uint32_t m_reserved2;
+    uint64_t m_checksum;   // FNV-1a over the header fields above and the records
+};
+struct SnapshotRecord{
+    uint64_t m_fields;     // PostNode::m_fields, packed post and NPL
+    int32_t m_key;
+    uint32_t m_links;      // SNAPSHOTLEFT | index of the right child record
+};
+static_assert(sizeof(SnapshotHeader) == 48 && sizeof(SnapshotRecord) == 16, "snapshot layout");
+
+// Checks shared by SQueue::loadSnapshot and MappedSQueue
+struct SnapshotFormat{
+    static void initHeader(SnapshotHeader& header);
+    static uint64_t checksum(const SnapshotHeader& header, const SnapshotRecord* records, size_t count);
+    // Throws domain_error unless the header is valid and the records
+    // (fileRecords of them present) form the shape the header describes.
+    // Only the trees can be bounded, eviction cuts nodes out of a tree.
+    static void check(const SnapshotHeader& header, const SnapshotRecord* records, size_t fileRecords);
+};
+
+// Function types used by SQueue to call the kernel matching its runtime
+// heap type and structure
+typedef nodeid_t (*mergefn_t)(NodeTable nodes, nodeid_t h1, nodeid_t h2, vector<nodeid_t>& path);
+typedef nodeid_t (*buildfn_t)(NodeTable nodes, vector<nodeid_t>& ids, vector<nodeid_t>& path);
+typedef nodeid_t (*popfn_t)(NodeTable nodes, nodeid_t root, vector<nodeid_t>& path);
+typedef nodeid_t (*cutfn_t)(NodeTable nodes, nodeid_t root, nodeid_t node);
+
+// Returned by insertPost and tests false when the post was rejected. It
+// stays valid until the post leaves the queue, or the queue is cleared or
+// merged into another queue.
+class PostHandle{
+    public:
+    friend class SQueue;
+    PostHandle() {m_node = NULLNODE; m_postID = 0;}
+    explicit operator bool() const {return (m_node != NULLNODE);}
+    int getPostID() const {return m_postID;}
+
+    private:
+    PostHandle(nodeid_t node, int postID) {m_node = node; m_postID = postID;}
+    nodeid_t m_node;  // node holding the post
+    int m_postID;     // checked against the node before every use
+};
+
 class SQueue{
     public:
     friend class Grader; // for grading purposes
     friend class Tester; // for testing purposes
+    friend class MultiSQueue; // shards compare bestKey() without popping
+    friend class OrderedIterator;
     
-    SQueue(){}
+    SQueue();
     SQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure);
+    // Same as above, but nodes come from the given pool which may be shared
+    // with other queues, e.g. all queues that will later be merged together.
+    SQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure, shared_ptr<PostPool> pool);
     ~SQueue();
     SQueue(const SQueue& rhs);
     SQueue& operator=(const SQueue& rhs);
-    bool insertPost(const Post& post);
+    // Moves take over the nodes and the pool in O(1). The moved-from queue
+    // is empty and gets a new pool the next time it needs one. Move
+    // assignment first clears this queue, which does not allocate.
+    SQueue(SQueue&& rhs) noexcept;
+    SQueue& operator=(SQueue&& rhs) noexcept;
+    PostHandle insertPost(const Post& post);
+    // Same as insertPost(Post(ID, likes, connectLevel, postTime, interestLevel)),
+    // but the fields are packed straight into a pool node. The priority
+    // function is called on the post unpacked from that node.
+    PostHandle emplacePost(int ID, int likes, int connectLevel, int postTime, int interestLevel);
+    // Insert a batch of posts, invalid posts (priority 0) are skipped.
+    // The batch is built into a heap in O(n) and then merged into the queue.
+    // Returns the number of posts inserted.
+    template <class InputIt>
+    int insertPosts(InputIt first, InputIt last);
+    int insertPosts(const vector<Post>& posts);
     Post getNextPost(); // Returns the highest priority post
+    // Non-throwing versions of getNextPost for polling a possibly empty queue
+    optional<Post> tryGetNextPost();
+    // Look at the posts in priority order without removing them. These
+    // finish a pending rebuild but do not otherwise change the queue.
+    Post peek(); // Throws out_of_range if empty
+    optional<Post> tryPeek();
+    vector<Post> topK(int k); // The first k posts, O(k log k) for skew/leftist
+    OrderedIterator orderedPosts(); // Lazy walk over every post in order
+    bool tryGetNextPost(Post& post); // Returns false and leaves post unchanged if empty
+    // Remove up to k posts in priority order in one call. The vector
+    // version appends to out, the pointer version writes out[0..k-1] and
+    // out must have room for k posts. Both return the number removed.
+    int getNextPosts(int k, vector<Post>& out);
+    int getNextPosts(int k, Post* out);
+    // Meld rhs into this queue and leave it empty. Node ids are unique
+    // across pools, so when rhs has a pool of its own this queue's pool
+    // adopts rhs's slabs in O(slabs) without copying a node (see
+    // PostPool::adopt). The meld is then O(log n) for skew and leftist
+    // heaps and O(1) for PAIRING, as for queues sharing one pool. rhs's
+    // nodes are copied, O(size of rhs), only when its pool is also used
+    // by other queues. BUCKET and DARY re-add every node of rhs, and a
+    // pending rebuild of either queue is finished first.
     void mergeWithQueue(SQueue& rhs);
+    // Meld every queue in queues into this one, leaving them empty. Every
+    // source pool is first adopted into this queue's pool in one pass,
+    // O(slabs), so the queues then meet in a balanced tournament (log2
+    // rounds of pairwise merges) of plain melds that copy no node, O(k
+    // log n) in total for k tree queues. The pairs of a round run on up to numThreads threads, 0 meaning one per
+    // hardware thread, which pays off when the merges re-add nodes
+    // (BUCKET, DARY) or finish pending rebuilds. A source whose pool is
+    // also used by queues outside the merge is copied instead, and then
+    // every round runs on the calling thread. Throws domain_error before
+    // anything is merged if a queue is incompatible or appears twice.
+    // Capacities are suspended during the rounds and restored afterwards,
+    // also when a merge throws; this queue then trims to its own.
+    void mergeAll(const vector<SQueue*>& queues, int numThreads = 0);
     void clear();
     int numPosts() const; // Returns number of posts in queue
     void printPostsQueue() const; // Print the queue using preorder traversal
     prifn_t getPriorityFn() const;
-    // Set a new priority function. Must rebuild the heap!!!
+    // Set a new priority function. The heap is rebuilt lazily, see below.
     void setPriorityFn(prifn_t priFn, HEAPTYPE heapType);
+    // Same, with linear describing priFn (see setLinearPriority)
+    void setPriorityFn(prifn_t priFn, HEAPTYPE heapType, const LinearPriority& linear);
+    // Lets insertPosts and rebuilds score posts in SIMD blocks instead of
+    // calling the priority function. linear must give the same keys as the
+    // priority function; setPriorityFn without one drops it.
+    void setLinearPriority(const LinearPriority& linear);
+    optional<LinearPriority> getLinearPriority() const;
     HEAPTYPE getHeapType() const;
     STRUCTURE getStructure() const;
-    // Set a new data structure (skew/leftist). Must rebuild the heap!!!
+    // Set a new data structure. The heap is rebuilt lazily, see below.
     void setStructure(STRUCTURE structure);
+    // Declare the range of priorities used by the BUCKET structure. Posts
+    // whose priority falls outside it are kept in a skew heap instead.
+    void setKeyRange(int minKey, int maxKey);
+    // setPriorityFn, setStructure and setKeyRange only mark the heap for a
+    // rebuild. Each insert then moves up to the rebuild budget of nodes into
+    // the new structure, and the first operation that needs heap order
+    // (a pop, a merge) finishes the rest.
+    bool rebuildPending() const;
+    bool rebuildStep(int maxNodes); // Returns true while a rebuild is still pending
+    void finishRebuild();
+    void setRebuildBudget(int maxNodes); // Nodes moved per insert, 0 disables
+    int getRebuildBudget() const;
+    // Threads finishRebuild uses once MINPARALLELREBUILD posts are queued,
+    // 0 means one per hardware thread. With more than one the priority
+    // function is called from several threads at once.
+    void setRebuildThreads(int numThreads);
+    int getRebuildThreads() const;
+    // Counters and latency histograms, see SQueueStats. Copying or moving
+    // a queue does not carry its stats over.
+    SQueueStats stats() const;
+    void resetStats();
+    static bool statsEnabled(); // true when built with SQUEUE_STATS
+    // Change or remove a queued post through its handle or its post ID.
+    // The node's subtree is cut out and melded back, O(log n) amortized.
+    // Needs a tree structure (SKEW, LEFTIST or PAIRING), BUCKET and DARY
+    // throw domain_error. The post ID index is built on the first lookup
+    // by ID; IDs should be unique, lookups find the latest insert. On a
+    // pool shared with other queues a handle is also followed up to this
+    // queue's root, O(depth), so a handle never reaches another queue.
+    bool removePost(PostHandle handle); // false when the handle is stale
+    bool removePost(int postID);        // false when no post has the ID
+    // Replace the post, which moves up or down with its new priority. An
+    // invalid new post (priority 0) is removed and false is returned.
+    bool updatePost(PostHandle handle, const Post& post);
+    bool updatePost(int postID, const Post& post);
+    bool updateLikes(int postID, int likes);
+    PostHandle findPost(int postID);
+    // Keep at most maxPosts posts (0 means unbounded). When the queue is
+    // full an insert evicts the worst post if the new one ranks higher and
+    // is rejected otherwise, in O(log n). Needs a tree structure like the
+    // update functions; excess posts are evicted right away.
+    void setCapacity(int maxPosts);
+    int getCapacity() const;
+    // Windowed mode keeps the posts of the newest `windows` windows (a
+    // window is one run of MAXTIME post times), 0 turns it off. Only on an
+    // empty, unbounded queue; windowed queues cannot be merged.
+    void setWindow(int windows);
+    int getWindow() const;
+    // Starts a new window. Posts of the windows that fall out expire in
+    // O(1): they leave numPosts and are skipped by pops, peeks, handles and
+    // ordered walks until compactExpired frees them. Throws domain_error
+    // unless the queue is windowed.
+    void advanceWindow(int steps = 1);
+    uint64_t currentWindow() const;
+    // Frees every expired node in one pass and rebuilds in O(n). Runs by
+    // itself once expired nodes outnumber the live posts.
+    void compactExpired();
+    int numExpired() const; // Expired nodes not freed yet
     void dump() const; // For debugging purposes
+    shared_ptr<PostPool> getPool() const; // Allocator that owns the nodes
+    // Write the queue to a snapshot (see SnapshotHeader), finishing a
+    // pending rebuild first. Loading replaces this queue's posts, heap type,
+    // structure, key range and capacity with the saved ones and restores
+    // the exact heap in one linear pass, without comparisons or priority
+    // calls. The queue must use the priority function the snapshot was
+    // saved with. Both throw domain_error on I/O errors or a bad file; a
+    // failed load leaves the queue unchanged.
+    void saveSnapshot(ostream& out);
+    void saveSnapshot(const string& path);
+    void loadSnapshot(istream& in);
+    void loadSnapshot(const string& path);
 
     private:
-    Post * m_heap;          // Pointer to root of the heap
+    nodeid_t m_heap;        // Root of the heap
     int m_size;             // Current size of the heap
     prifn_t m_priorFunc;    // Function to compute priority
     HEAPTYPE m_heapType;    // either a MINHEAP or a MAXHEAP
-    STRUCTURE m_structure;  // skew heap or leftist heap
+    STRUCTURE m_structure;  // skew, leftist, bucket, pairing or d-ary heap
+    shared_ptr<PostPool> m_pool; // Allocator for the heap nodes
+    vector<nodeid_t> m_mergePath; // Scratch path for the leftist merge
+    vector<nodeid_t> m_buildList; // Scratch work list for buildHeap
+    vector<nodeid_t> m_batchList; // Scratch list of the nodes getNextPosts removes
+    BucketIndex m_buckets;       // Buckets of the BUCKET structure, m_heap holds the rest
+    int m_minKey;                // Key range declared for BUCKET
+    int m_maxKey;
+    vector<nodeid_t> m_stale;    // Subtrees waiting for a pending rebuild
+    bool m_refreshKeys;          // m_stale nodes need m_key recomputed
+    int m_rebuildBudget;         // Nodes moved per insert while a rebuild is pending
+    int m_rebuildThreads;        // Threads of a large finishRebuild, 0 for all
+    optional<LinearPriority> m_linear; // m_priorFunc as weights, for scoreBlock
+    int m_windowSize;            // Windows a windowed queue keeps, 0 when off
+    uint64_t m_window;           // Window new posts are stamped with
+    uint64_t m_compactedAt;      // m_window when expired nodes were last freed
+    vector<int> m_windowCounts;  // Live posts per window, slot window % m_windowSize
+    int m_expired;               // Expired nodes still in the structure
+    unordered_map<int, nodeid_t> m_index; // Post ID to node, valid while m_indexed
+    bool m_indexed;              // m_index is built and kept up to date
+    int m_capacity;              // Most posts kept, 0 when unbounded
+    IndexedHeap m_evict;         // Bounded queue in reverse order, worst post on top
+    bool m_evictValid;           // m_evict matches the heap
+    DaryHeap m_dary;             // Array heap of the DARY structure
+    mergefn_t m_mergeFn;         // HeapEngine::merge for m_heapType/m_structure
+    buildfn_t m_buildFn;         // HeapEngine::build for m_heapType/m_structure
+    popfn_t m_popFn;             // HeapEngine::pop for m_heapType/m_structure
+    cutfn_t m_cutFn;             // HeapEngine::cut for m_heapType/m_structure
+#ifdef SQUEUE_STATS
+    SQueueStats m_stats;         // Filled through activeStats while an operation runs
+#endif
 
-    void dump(Post *pos) const; // helper function for dump
+    void dump(nodeid_t pos, bool stale = false) const; // helper function for dump
 
     /******************************************
      * Private function declarations go here! *
      ******************************************/
     
-     Post* mergeNodes(Post* h1, Post* h2);
-     void clearHelper(Post* node);
-     Post* deepCopy(Post* node);
-     void rebuildHeap(); // rebuild using current priority function/structure
+     nodeid_t mergeNodes(nodeid_t h1, nodeid_t h2);
+     void clearHelper(nodeid_t node);
+     nodeid_t deepCopy(const SQueue& rhs); // copies rhs's heap into m_pool
+     void rebuildHeap(); // marks a rebuild for the current structure
+     void markRebuild(bool refreshKeys); // moves every node to m_stale
+     void ensureOrder(); // finishes a pending rebuild
+     nodeid_t findNode(int postID); // builds m_index on first use
+     nodeid_t handleNode(PostHandle handle) const; // NULLNODE for a stale handle
+     void checkTreeStructure(); // throws unless the structure supports cuts
+     void unindex(nodeid_t node); // drops node's m_index entry
+     void eraseNode(nodeid_t node); // unlinks, unindexes and releases node
+     void updateNode(nodeid_t node, int key, const Post& post);
+     void listNodes(vector<nodeid_t>& ids) const; // appends the ids of m_heap, links untouched
+     HEAPTYPE evictOrder() const {return (m_heapType == MINHEAP ? MAXHEAP : MINHEAP);} // order of m_evict
+     void ensureEvictIndex(); // rebuilds m_evict when invalid
+     void trimToCapacity(); // evicts the worst posts down to m_capacity
+     bool makeRoom(int key); // false when a full bounded queue rejects key, evicts otherwise
+     PostHandle linkNewNode(nodeid_t node); // links a keyed new node into the queue
  
      // Added private helper functions (allowed modifications)
-     static bool comparePosts(prifn_t func, HEAPTYPE heapType, const Post* h1, const Post* h2);
-     static void rebuildHelper(Post* node, Post*& newHeap, SQueue* queuePtr);
+     void selectEngine(); // picks m_mergeFn/m_buildFn/m_popFn/m_cutFn
+     template <HEAPTYPE heapType>
+     void selectKernels(); // selectEngine for one heap type
+     void ensurePool();   // creates m_pool for a moved-from queue
+     void popRoot(Post& post); // detaches the best post, queue must not be empty
+     nodeid_t detachBest(); // unlinks the best node, popRoot without the release
+     void extractTop(int count, Post* out); // detaches the best count tree nodes into m_batchList
+     void dropNodes(const vector<nodeid_t>& ids); // unindexes and releases detached nodes
+     bool higherPriority(int key1, int key2) const; // key1 goes first
+     int bestKey(); // key of the next post, 0 when empty
+     nodeid_t bestNode() const; // node of the next post, the queue must be ordered and not empty
+     void addNode(nodeid_t node); // links a detached node into the structure
+     void addNodes(vector<nodeid_t>& nodes); // same for many nodes, overwrites nodes
+     void collectNodes(vector<nodeid_t>& nodes); // detaches every node of the queue
+     void resetStructure(); // empties m_heap/m_buckets/m_dary for the current structure
+     void rebuildHelper(nodeid_t node, vector<nodeid_t>& nodes);
+     void refreshKeys(vector<nodeid_t>& nodes); // recompute m_key with m_priorFunc or m_linear
+     void addScored(const Post* posts, int count); // insertPosts for one block, scored with m_linear
+     bool isExpired(nodeid_t node) const; // stamped in a window that fell out
+     void stampNode(nodeid_t node); // counts a new node in the current window
+     bool forgetNode(nodeid_t node); // window bookkeeping of a leaving node, false if it had expired
+     void skipExpired(); // drops expired nodes until the best post is live
+     void parallelRebuild(int numThreads); // finishRebuild on several threads
+     nodeid_t buildHeap(vector<nodeid_t>& nodes); // melds detached nodes pairwise
  
-     // Recursive helper for printPostsQueue
-     void printPreOrder(Post* node) const;
+     // Traversal helper for printPostsQueue
+     void printPreOrder(nodeid_t node, bool stale = false) const;
+     // Key to print for node, stale when it waits in a pending rebuild
+     int printKey(const PostNode& node, bool stale) const;
+     // Snapshot helpers
+     void snapshotRecords(vector<SnapshotRecord>& records, uint32_t& numFlat) const;
+     void restoreRecords(const SnapshotHeader& header, const vector<SnapshotRecord>& records);
 };
 
 ostream& operator<<(ostream& sout, const Post& post);
+
+// Returned by SQueue::orderedPosts. Walks the queue in priority order with
+// a frontier heap of candidates that starts with the best post; each step
+// returns the best candidate and adds the nodes only it was guarding: its
+// children in a tree, the array heap or a pairing heap, or the next post
+// of a bucket. The first k posts cost O(k log k) (for a pairing heap, the
+// children of the returned posts). The queue must not change while the
+// iterator is in use.
+class OrderedIterator{
+    public:
+    friend class SQueue;
+    bool hasNext() const {return !m_frontier.empty();}
+    Post next(); // Throws out_of_range when every post has been returned
+
+    private:
+    enum SOURCE {TREENODE, DARYPOS, BUCKETNODE};
+    struct Candidate{
+        int m_key;
+        nodeid_t m_ref;   // node id, or position in the array heap
+        SOURCE m_source;
+    };
+    const SQueue* m_queue;
+    vector<Candidate> m_frontier;
+
+    explicit OrderedIterator(const SQueue& queue);
+    void push(int key, nodeid_t ref, SOURCE source);
+    nodeid_t take(); // pops the best candidate, adds what it guarded, returns its node
+    void skipExpired(); // takes expired candidates until a live one is on top
+    bool lowerPriority(const Candidate& c1, const Candidate& c2) const;
+};
+
+template <HEAPTYPE heapType, STRUCTURE structure>
+nodeid_t HeapEngine::merge(NodeTable nodes, nodeid_t h1, nodeid_t h2, vector<nodeid_t>& path) {
+    // The sentinel is shared by every pool, so it is never written
+    if (h1 == NULLNODE) {
+        if (h2 != NULLNODE) nodes[h2].m_parent = NULLNODE;
+        return h2;
+    }
+    if (h2 == NULLNODE) {nodes[h1].m_parent = NULLNODE; return h1;}
+    if (structure == PAIRING) return link<heapType>(nodes, h1, h2); // O(1) meld
+    nodeid_t root = NULLNODE;
+    nodeid_t* slot = &root; // link that receives the next chosen root
+    nodeid_t parent = NULLNODE; // node owning slot
+    if (structure == SKEW) {
+        // Skew heap: the merged right subtree becomes the left child and
+        // the old left child moves to the right.
+        uint64_t steps = 0; // meld path length, read only by the stats hooks
+        while (h1 != NULLNODE && h2 != NULLNODE) {
+            bool keep = before<heapType>(nodes[h1], nodes[h2]);
+            nodeid_t top = (keep ? h1 : h2);
+            h2 = (keep ? h2 : h1);
+            PostNode& node = nodes[top];
+            *slot = top;
+            node.m_parent = parent;
+            h1 = node.m_right;
+            node.m_right = node.m_left;
+            slot = &node.m_left;
+            parent = top;
+            steps++;
+        }
+        *slot = (h1 != NULLNODE ? h1 : h2);
+        if (*slot != NULLNODE) nodes[*slot].m_parent = parent;
+        SQUEUE_STAT(addMergePath(steps));
+        SQUEUE_STAT(m_childSwaps += steps);
+    } else {
+        // Leftist heap: first pass descends the right spines, the second
+        // pass unwinds the path restoring NPL(left) >= NPL(right).
+        path.clear();
+        while (h1 != NULLNODE && h2 != NULLNODE) {
+            bool keep = before<heapType>(nodes[h1], nodes[h2]);
+            nodeid_t top = (keep ? h1 : h2);
+            h2 = (keep ? h2 : h1);
+            *slot = top;
+            nodes[top].m_parent = parent;
+            path.push_back(top);
+            slot = &nodes[top].m_right;
+            parent = top;
+            h1 = *slot;
+        }
+        *slot = (h1 != NULLNODE ? h1 : h2);
+        if (*slot != NULLNODE) nodes[*slot].m_parent = parent;
+        // The sentinel has NPL 0, so empty children need no special case.
+        for (size_t i = path.size(); i-- > 0;) {
+            PostNode& node = nodes[path[i]];
+            if (nodes[node.m_left].npl() < nodes[node.m_right].npl()) {
+                nodeid_t temp = node.m_left;
+                node.m_left = node.m_right;
+                node.m_right = temp;
+                SQUEUE_STAT(m_childSwaps++);
+            }
+            node.setNpl(node.m_right != NULLNODE ? nodes[node.m_right].npl() + 1 : 0);
+        }
+        SQUEUE_STAT(addMergePath(path.size()));
+    }
+    return root;
+}
+
+// Melds neighbours pairwise in rounds, which is the same as taking two
+// heaps off the front of a FIFO work list and appending their meld.
+template <HEAPTYPE heapType, STRUCTURE structure>
+nodeid_t HeapEngine::build(NodeTable nodes, vector<nodeid_t>& ids, vector<nodeid_t>& path) {
+    size_t count = ids.size();
+    if (count == 0) return NULLNODE;
+    while (count > 1) {
+        size_t out = 0;
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            ids[out++] = merge<heapType, structure>(nodes, ids[i], ids[i + 1], path);
+        }
+        if (count % 2 == 1) ids[out++] = ids[count - 1];
+        count = out;
+    }
+    return ids[0];
+}
+
+// Skew and leftist heaps meld the two subtrees. The pairing heap melds
+// the children pairwise left to right, then the pairs right to left.
+template <HEAPTYPE heapType, STRUCTURE structure>
+nodeid_t HeapEngine::pop(NodeTable nodes, nodeid_t root, vector<nodeid_t>& path) {
+    PostNode& top = nodes[root];
+    if (structure != PAIRING) return merge<heapType, structure>(nodes, top.m_left, top.m_right, path);
+    path.clear();
+    nodeid_t child = top.m_left;
+    top.m_left = NULLNODE;
+    while (child != NULLNODE) {
+        nodeid_t first = child;
+        nodeid_t second = nodes[first].m_right;
+        nodes[first].m_right = NULLNODE;
+        if (second == NULLNODE) {
+            path.push_back(first);
+            break;
+        }
+        child = nodes[second].m_right;
+        nodes[second].m_right = NULLNODE;
+        path.push_back(link<heapType>(nodes, first, second));
+    }
+    nodeid_t result = NULLNODE;
+    for (size_t i = path.size(); i-- > 0;) {
+        result = (result == NULLNODE ? path[i] : link<heapType>(nodes, path[i], result));
+    }
+    if (result != NULLNODE) nodes[result].m_parent = NULLNODE;
+    return result;
+}
+
+template <HEAPTYPE heapType>
+nodeid_t HeapEngine::link(NodeTable nodes, nodeid_t h1, nodeid_t h2) {
+    bool keep = before<heapType>(nodes[h1], nodes[h2]);
+    nodeid_t top = (keep ? h1 : h2);
+    nodeid_t child = (keep ? h2 : h1);
+    nodeid_t sibling = nodes[top].m_left;
+    nodes[child].m_right = sibling;
+    if (sibling != NULLNODE) nodes[sibling].m_parent = child;
+    nodes[top].m_left = child;
+    nodes[child].m_parent = top;
+    nodes[top].m_parent = NULLNODE;
+    return top;
+}
+
+// Skew and leftist clear the parent's link to node, then leftist repairs
+// NPL upwards until it stops changing. In a pairing heap the parent link
+// is the previous sibling (or the parent for a first child) and node's
+// next sibling takes its place.
+template <HEAPTYPE heapType, STRUCTURE structure>
+nodeid_t HeapEngine::cut(NodeTable nodes, nodeid_t root, nodeid_t node) {
+    PostNode& cutNode = nodes[node];
+    nodeid_t parent = cutNode.m_parent;
+    nodeid_t rest = (structure == PAIRING ? cutNode.m_right : NULLNODE);
+    if (nodes[parent].m_left == node) nodes[parent].m_left = rest;
+    else nodes[parent].m_right = rest;
+    if (rest != NULLNODE) nodes[rest].m_parent = parent;
+    if (structure == PAIRING) cutNode.m_right = NULLNODE;
+    cutNode.m_parent = NULLNODE;
+    if (structure == LEFTIST) {
+        for (nodeid_t id = parent; id != NULLNODE; id = nodes[id].m_parent) {
+            PostNode& up = nodes[id];
+            if (nodes[up.m_left].npl() < nodes[up.m_right].npl()) {
+                nodeid_t temp = up.m_left;
+                up.m_left = up.m_right;
+                up.m_right = temp;
+            }
+            int npl = (up.m_right != NULLNODE ? nodes[up.m_right].npl() + 1 : 0);
+            if (npl == up.npl()) break;
+            up.setNpl(npl);
+        }
+    }
+    return root;
+}
+
+template <class InputIt>
+int SQueue::insertPosts(InputIt first, InputIt last) {
+    if (m_capacity > 0) {
+        // Every insert may evict, so a bounded queue takes them one by one.
+        int count = 0;
+        for (; first != last; ++first) {
+            if (insertPost(*first)) count++;
+        }
+        return count;
+    }
+    SQUEUE_STATS_SCOPE(nullptr);
+    if (!m_stale.empty()) rebuildStep(m_rebuildBudget);
+    m_buildList.clear();
+    if (m_linear) {
+        Post block[SCOREBLOCK];
+        int count = 0;
+        for (; first != last; ++first) {
+            block[count++] = *first;
+            if (count == SCOREBLOCK) {
+                addScored(block, count);
+                count = 0;
+            }
+        }
+        addScored(block, count);
+    }
+    for (; first != last; ++first) {
+        const Post& post = *first;
+        int key = m_priorFunc(post);
+        SQUEUE_STAT(m_priorityCalls++);
+        if (key == 0) continue;
+        ensurePool();
+        nodeid_t node = m_pool->allocate(post);
+        m_pool->node(node).m_key = key;
+        if (m_indexed) m_index[post.getPostID()] = node;
+        m_buildList.push_back(node);
+    }
+    int count = (int)m_buildList.size();
+    if (m_windowSize > 0) {
+        for (nodeid_t node : m_buildList) stampNode(node);
+    }
+    addNodes(m_buildList);
+    m_size += count;
+    return count;
+}
+
+template <class Visit>
+void BucketIndex::forEach(NodeTable nodes, HEAPTYPE heapType, Visit visit) const {
+    int numBuckets = (int)m_head.size();
+    for (int i = 0; i < numBuckets; i++) {
+        int bucket = (heapType == MINHEAP ? i : numBuckets - 1 - i);
+        for (nodeid_t id = m_head[bucket]; id != NULLNODE; id = nodes[id].m_right) {
+            visit(id);
+        }
+    }
+}
+template <class Visit>
+void DaryHeap::forEach(Visit visit) const {
+    for (const Entry& entry : m_entries) visit(entry.m_id);
+}
 #endif
@@ -0,0 +1,206 @@
+/*Title: squeue_bench.cpp
+  Author: Onosetale Okooboh
+  Date: 04/14/2025
+  Description: Benchmark of the single threaded SQueue operations: insert,
+  getNextPost, mergeWithQueue, setPriorityFn (with the rebuild finished)
+  and the copy constructor. SKEW and LEFTIST are run as MINHEAP and
+  MAXHEAP from 1e3 posts up to the given maximum, with uniform, normal and
+  sorted likes, next to a std::priority_queue of (key, post) pairs doing
+  the same work. Posts come from the Random class of the tests with fixed
+  seeds, so every run uses the same workload.
+
+  Results go to stdout as JSON, one record per (queue, heap, distribution,
+  size, operation) with the best time over a few repetitions.
+
+  The two queues of the mergeWithQueue case have pools of their own. The
+  first pool adopts the second one's slabs without copying a node (see
+  PostPool::adopt), so the figure is the O(log n) meld plus O(slabs).
+
+  Build: cmake target squeue_bench
+  Usage: ./squeue_bench [max posts, default 10000000]
+*/
+#include "squeue.h"
+#include "randomgen.h"
+#include <chrono>
+#include <queue>
+#include <iomanip>
+using namespace std;
+
+const int MINBENCHPOSTS = 1000;//smallest size run
+const int MINBENCHWORK = 100000;//posts handled per case, small sizes repeat
+enum DISTRIBUTION {UNIFORMDIST, NORMALDIST, SORTEDDIST};
+const char* DISTNAMES[] = {"uniform", "normal", "sorted"};
+enum OPERATION {INSERTOP, POPOP, MERGEOP, REBUILDOP, COPYOP, NUMOPS};
+const char* OPNAMES[] = {"insert", "getNextPost", "mergeWithQueue", "setPriorityFn", "copy"};
+
+// Keys are 1..510 for every valid post, so no post is rejected
+int likesPriority(const Post &post) {
+    return post.getNumLikes() + post.getInterestLevel();
+}
+
+// The priority the rebuild switches to, 2..55
+int timePriority(const Post &post) {
+    return post.getPostTime() + post.getConnectLevel();
+}
+
+// Sorted posts have increasing likes, the worst case for a MAXHEAP skew heap
+vector<Post> makePosts(int numPosts, DISTRIBUTION dist) {
+    Random ids(MINPOSTID, MAXPOSTID);
+    Random likes(MINLIKES, MAXLIKES, dist == NORMALDIST ? NORMAL : UNIFORMINT, MAXLIKES / 2, MAXLIKES / 6);
+    Random levels(MINCONLEVEL, MAXCONLEVEL);
+    Random times(MINTIME, MAXTIME);
+    Random interests(MININTERESTLEVEL, MAXINTERESTLEVEL);
+    likes.setSeed(11);
+    levels.setSeed(12);
+    times.setSeed(13);
+    interests.setSeed(14);
+    vector<Post> posts;
+    posts.reserve(numPosts);
+    for (int i = 0; i < numPosts; i++) {
+        int numLikes = (dist == SORTEDDIST ? (int)((long long)i * (MAXLIKES + 1) / numPosts) : likes.getRandNum());
+        int interest = (dist == SORTEDDIST ? MININTERESTLEVEL : interests.getRandNum());
+        posts.push_back(Post(ids.getRandNum(), numLikes, levels.getRandNum(), times.getRandNum(), interest));
+    }
+    return posts;
+}
+
+// Baseline: std::priority_queue of cached keys and posts. The container is
+// protected, the subclass reaches it to rekey and heapify for a rebuild.
+struct Entry{
+    int m_key;
+    Post m_post;
+};
+
+struct EntryOrder{
+    HEAPTYPE m_heapType;
+    bool operator()(const Entry& e1, const Entry& e2) const {
+        return (m_heapType == MINHEAP ? e1.m_key > e2.m_key : e1.m_key < e2.m_key);
+    }
+};
+
+class BaselineQueue : public priority_queue<Entry, vector<Entry>, EntryOrder> {
+    public:
+    BaselineQueue(prifn_t priFn, HEAPTYPE heapType)
+        : priority_queue<Entry, vector<Entry>, EntryOrder>(EntryOrder{heapType}), m_priorFunc(priFn) {}
+    void insertPost(const Post& post) {push(Entry{m_priorFunc(post), post});}
+    Post getNextPost() {
+        Post post = top().m_post;
+        pop();
+        return post;
+    }
+    void mergeWithQueue(BaselineQueue& rhs) {
+        for (const Entry& entry : rhs.c) push(entry);
+        rhs.c.clear();
+    }
+    void setPriorityFn(prifn_t priFn, HEAPTYPE heapType) {
+        m_priorFunc = priFn;
+        comp = EntryOrder{heapType};
+        for (Entry& entry : c) entry.m_key = priFn(entry.m_post);
+        make_heap(c.begin(), c.end(), comp);
+    }
+    private:
+    prifn_t m_priorFunc;
+};
+
+// Keeps the compiler from dropping the popped posts
+long long checksum = 0;
+
+template <class Queue>
+void drain(Queue& queue, int numPosts) {
+    for (int i = 0; i < numPosts; i++) checksum += queue.getNextPost().getPostID();
+}
+
+void finishRebuild(SQueue& queue) {queue.finishRebuild();}
+void finishRebuild(BaselineQueue&) {}
+
+// One pass of every operation, times in seconds. makeQueue returns an
+// empty queue of the kind measured.
+template <class MakeQueue>
+void runOnce(const vector<Post>& posts, HEAPTYPE heapType, MakeQueue makeQueue, double times[NUMOPS]) {
+    typedef chrono::steady_clock Clock;
+    int numPosts = (int)posts.size();
+    int half = numPosts / 2;
+    auto queue = makeQueue();
+    Clock::time_point start = Clock::now();
+    for (const Post& post : posts) queue.insertPost(post);
+    times[INSERTOP] = chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    auto copy(queue);
+    times[COPYOP] = chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    drain(queue, numPosts);
+    times[POPOP] = chrono::duration<double>(Clock::now() - start).count();
+
+    auto first = makeQueue();
+    auto second = makeQueue();
+    for (int i = 0; i < half; i++) first.insertPost(posts[i]);
+    for (int i = half; i < numPosts; i++) second.insertPost(posts[i]);
+    start = Clock::now();
+    first.mergeWithQueue(second);
+    times[MERGEOP] = chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    copy.setPriorityFn(timePriority, heapType);
+    finishRebuild(copy);
+    times[REBUILDOP] = chrono::duration<double>(Clock::now() - start).count();
+    drain(copy, 1);
+}
+
+// Best of a few runs, so that small sizes are not dominated by noise
+template <class MakeQueue>
+void runCase(const vector<Post>& posts, HEAPTYPE heapType, MakeQueue makeQueue, double best[NUMOPS]) {
+    int reps = max(3, MINBENCHWORK / (int)posts.size());
+    for (int op = 0; op < NUMOPS; op++) best[op] = -1;
+    for (int rep = 0; rep < reps; rep++) {
+        double times[NUMOPS];
+        runOnce(posts, heapType, makeQueue, times);
+        for (int op = 0; op < NUMOPS; op++) {
+            if (best[op] < 0 || times[op] < best[op]) best[op] = times[op];
+        }
+    }
+}
+
+void printRecords(bool& firstRecord, const string& impl, HEAPTYPE heapType, DISTRIBUTION dist,
+                  int numPosts, const double times[NUMOPS]) {
+    for (int op = 0; op < NUMOPS; op++) {
+        cout << (firstRecord ? "\n" : ",\n") << "    {\"impl\": \"" << impl
+             << "\", \"heap\": \"" << (heapType == MINHEAP ? "MINHEAP" : "MAXHEAP")
+             << "\", \"dist\": \"" << DISTNAMES[dist] << "\", \"posts\": " << numPosts
+             << ", \"op\": \"" << OPNAMES[op] << "\", \"seconds\": " << scientific << setprecision(6) << times[op]
+             << ", \"ns_per_post\": " << fixed << setprecision(2) << times[op] * 1e9 / numPosts << "}";
+        firstRecord = false;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int maxPosts = (argc > 1 ? atoi(argv[1]) : 10000000);
+    if (maxPosts < MINBENCHPOSTS) {
+        cerr << "Usage: " << argv[0] << " [max posts >= " << MINBENCHPOSTS << "]" << endl;
+        return 1;
+    }
+    HEAPTYPE heapTypes[] = {MINHEAP, MAXHEAP};
+    DISTRIBUTION dists[] = {UNIFORMDIST, NORMALDIST, SORTEDDIST};
+    bool firstRecord = true;
+    cout << "{\n  \"benchmark\": \"squeue_bench\",\n  \"max_posts\": " << maxPosts << ",\n  \"results\": [";
+    for (long long numPosts = MINBENCHPOSTS; numPosts <= maxPosts; numPosts *= 10) {
+        for (DISTRIBUTION dist : dists) {
+            vector<Post> posts = makePosts((int)numPosts, dist);
+            for (HEAPTYPE heapType : heapTypes) {
+                double times[NUMOPS];
+                STRUCTURE structures[] = {SKEW, LEFTIST};
+                for (STRUCTURE structure : structures) {
+                    runCase(posts, heapType, [heapType, structure]() {
+                        return SQueue(likesPriority, heapType, structure);
+                    }, times);
+                    printRecords(firstRecord, structure == SKEW ? "SKEW" : "LEFTIST", heapType, dist, (int)numPosts, times);
+                }
+                runCase(posts, heapType, [heapType]() {return BaselineQueue(likesPriority, heapType);}, times);
+                printRecords(firstRecord, "std::priority_queue", heapType, dist, (int)numPosts, times);
+            }
+        }
+    }
+    cout << "\n  ],\n  \"checksum\": " << checksum << "\n}" << endl;
+    return 0;
+}